@@ -0,0 +1,99 @@
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+#include <xoshiro-cpp/XoshiroCpp.hpp>
+
+#include "batched_lookup.hpp"
+#include "frozen_ngram_map.hpp"
+#include "ngram.hpp"
+#include "utils/blocked_bloom_filter.hpp"
+
+// Probe throughput of the aggregation pass's lookup structures, one probe at a time against batches of a message's
+// worth of probes. With maps larger than the last level cache the difference is the overlapped cache misses.
+struct lookup_fixture {
+    std::vector<std::string> keys;
+    frozen_ngram_map<2, std::uint32_t> map;
+    blocked_bloom_filter filter;
+    std::string probe_text; // probed keys are laid out in order, like they would be in the messages being counted
+    std::vector<ngram_probe<2>> probes;
+
+    explicit lookup_fixture(std::size_t size) {
+        std::vector<std::pair<packed_ngram<2>, std::uint32_t>> entries;
+        for(std::size_t i = 0; i < size; i++) {
+            keys.push_back(fmt::format("key{}", i));
+        }
+        for(std::size_t i = 0; i < size; i++) {
+            entries.emplace_back(ngram_view<2>{"the"sv, std::string_view(keys[i])}, 0);
+        }
+        map = frozen_ngram_map<2, std::uint32_t>(std::move(entries));
+        filter = blocked_bloom_filter(size, 0.01);
+        for(const auto& entry : map) {
+            filter.insert(ngram_hash{}(entry.first));
+        }
+        // about a quarter of aggregation probes hit, the rest are ngrams that didn't survive the first pass
+        XoshiroCpp::Xoroshiro128Plus rng(42);
+        constexpr std::size_t probe_count = 1 << 20;
+        std::vector<std::size_t> offsets;
+        for(std::size_t i = 0; i < probe_count; i++) {
+            offsets.push_back(probe_text.size());
+            probe_text += keys[rng() % size];
+        }
+        offsets.push_back(probe_text.size());
+        for(std::size_t i = 0; i < probe_count; i++) {
+            auto first = rng() % 4 == 0 ? "the"sv : "a"sv;
+            ngram_view<2> view{first, std::string_view(probe_text).substr(offsets[i], offsets[i + 1] - offsets[i])};
+            probes.push_back({view, ngram_hash{}(view)});
+        }
+    }
+};
+
+static lookup_fixture& fixture(std::size_t size) {
+    static std::map<std::size_t, std::unique_ptr<lookup_fixture>> fixtures;
+    auto& entry = fixtures[size];
+    if(!entry) {
+        entry = std::make_unique<lookup_fixture>(size);
+    }
+    return *entry;
+}
+
+static void Sequential(benchmark::State& state) {
+    auto& f = fixture(state.range(0));
+    std::size_t cursor = 0;
+    lookup_stats stats;
+    for(auto _ : state) {
+        for(std::size_t i = 0; i < 64; i++, cursor = (cursor + 1) % f.probes.size()) {
+            const auto& probe = f.probes[cursor];
+            if(!f.filter.may_contain(probe.hash)) {
+                stats.rejected++;
+            } else if(auto it = f.map.find(probe.key, probe.hash); it != f.map.end()) {
+                it->second++;
+            }
+        }
+    }
+    benchmark::DoNotOptimize(stats);
+    state.SetItemsProcessed(std::int64_t(state.iterations() * 64));
+}
+BENCHMARK(Sequential)->Arg(1 << 16)->Arg(1 << 22)->Arg(1 << 24);
+
+static void Batched(benchmark::State& state) {
+    auto& f = fixture(state.range(0));
+    std::size_t cursor = 0;
+    lookup_stats stats;
+    std::vector<ngram_probe<2>> batch;
+    for(auto _ : state) {
+        batch.clear();
+        for(std::size_t i = 0; i < 64; i++, cursor = (cursor + 1) % f.probes.size()) {
+            batch.push_back(f.probes[cursor]);
+        }
+        batched_lookup(f.map, f.filter, batch, stats, [](std::uint32_t& count) { count++; });
+    }
+    benchmark::DoNotOptimize(stats);
+    state.SetItemsProcessed(std::int64_t(state.iterations() * 64));
+}
+BENCHMARK(Batched)->Arg(1 << 16)->Arg(1 << 22)->Arg(1 << 24);
+
+BENCHMARK_MAIN();
@@ -25,11 +25,9 @@ static void Ngrams(benchmark::State& state) {
     std::uint64_t count = 0;
     for (auto _ : state) {
         tokenize(dummy_messages[rng() & (dummy_messages.size() - 1)], [&](const ngram_window& container) {
-            benchmark::DoNotOptimize(container.subview<1>());
-            benchmark::DoNotOptimize(container.subview<2>());
-            benchmark::DoNotOptimize(container.subview<3>());
-            benchmark::DoNotOptimize(container.subview<4>());
-            benchmark::DoNotOptimize(container.subview<5>());
+            indexinator<ngram_max_width>([&] <auto I> {
+                benchmark::DoNotOptimize(container.template subview<I + 1>());
+            });
             count++;
         });
         benchmark::DoNotOptimize(count);
@@ -37,4 +35,17 @@ static void Ngrams(benchmark::State& state) {
 }
 BENCHMARK(Ngrams);
 
+static void Unigrams(benchmark::State& state) {
+    XoshiroCpp::Xoshiro128Plus rng(42);
+    std::uint64_t count = 0;
+    for (auto _ : state) {
+        tokenize<1>(dummy_messages[rng() & (dummy_messages.size() - 1)], [&](const ngram_window_n<1>& container) {
+            benchmark::DoNotOptimize(container.subview<1>());
+            count++;
+        });
+        benchmark::DoNotOptimize(count);
+    }
+}
+BENCHMARK(Unigrams);
+
 BENCHMARK_MAIN();
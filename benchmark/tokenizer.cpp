@@ -0,0 +1,51 @@
+#include <array>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <xoshiro-cpp/XoshiroCpp.hpp>
+
+#include "ngram.hpp"
+#include "tokenization.hpp"
+#include "../test/tokenizer_corpus.hpp"
+
+// Tokenizer throughput per input class, reported as bytes per second over a generated corpus of about 4 MiB per
+// class in message sized pieces
+static const std::vector<std::string>& corpus(corpus_class cls) {
+    static std::array<std::vector<std::string>, corpus_classes.size()> corpora;
+    auto& messages = corpora[std::size_t(cls)];
+    if(messages.empty()) {
+        XoshiroCpp::Xoroshiro128Plus rng(42 + std::size_t(cls));
+        for(std::size_t size = 0; size < 4 << 20;) {
+            messages.push_back(generate_message(cls, rng, 16 + rng() % 512));
+            size += messages.back().size();
+        }
+    }
+    return messages;
+}
+
+template<std::size_t W>
+static void Tokenize(benchmark::State& state) {
+    auto cls = corpus_classes[state.range(0)];
+    const auto& messages = corpus(cls);
+    std::size_t bytes = 0;
+    std::uint64_t count = 0;
+    for(auto _ : state) {
+        for(const auto& message : messages) {
+            tokenize<W>(message, [&](const ngram_window_n<W>& container) {
+                indexinator<W>([&] <auto I> {
+                    benchmark::DoNotOptimize(container.template subview<I + 1>());
+                });
+                count++;
+            });
+            bytes += message.size();
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetBytesProcessed(std::int64_t(bytes));
+    state.SetLabel(std::string(corpus_class_names[state.range(0)]));
+}
+BENCHMARK(Tokenize<1>)->DenseRange(0, corpus_classes.size() - 1);
+BENCHMARK(Tokenize<ngram_max_width>)->DenseRange(0, corpus_classes.size() - 1);
+
+BENCHMARK_MAIN();
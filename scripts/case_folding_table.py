@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+# Generates src/utils/case_folding_table.hpp, the aggregator's lowercase mappings. They're meant to agree with
+# javascript's toLowerCase() followed by the server's fold_case() fixups, so they're the one to one lowercase mappings
+# plus final sigma and long s. U+0130 is the only multi-codepoint mapping and is handled in case_folding.hpp.
+# Usage: python3 scripts/case_folding_table.py > src/utils/case_folding_table.hpp
+
+import unicodedata
+
+mapping = {}
+for c in range(0x110000):
+    lower = chr(c).lower()
+    if lower != chr(c) and len(lower) == 1:
+        mapping[c] = ord(lower)
+# server/app.ts folds these after toLowerCase()
+mapping[0x3C2] = 0x3C3
+mapping[0x17F] = ord("s")
+
+# runs of codepoints with the same delta, either contiguous (stride 1) or alternating upper/lower (stride 2)
+ranges = []
+for c in sorted(mapping):
+    delta = mapping[c] - c
+    if ranges:
+        first, last, run_delta, stride = ranges[-1]
+        if run_delta == delta and c - last in (1, 2) and stride in (c - last, 0):
+            ranges[-1] = [first, c, delta, c - last]
+            continue
+    ranges.append([c, c, delta, 0])
+
+print(f"""#ifndef CASE_FOLDING_TABLE_HPP
+#define CASE_FOLDING_TABLE_HPP
+
+#include <array>
+#include <cstdint>
+
+// Generated by scripts/case_folding_table.py from Unicode {unicodedata.unidata_version}, don't edit by hand
+
+namespace detail {{
+    struct fold_range {{
+        char32_t first;
+        char32_t last;
+        std::int32_t delta;
+        std::uint32_t stride; // every codepoint of the range or every other one
+    }};
+
+    inline constexpr std::array<fold_range, {len(ranges)}> fold_ranges = {{{{""")
+for first, last, delta, stride in ranges:
+    print(f"        {{0x{first:X}, 0x{last:X}, {delta}, {max(stride, 1)}}},")
+print("""    }};
+}
+
+#endif""")
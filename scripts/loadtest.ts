@@ -0,0 +1,186 @@
+// Load generator for the query endpoint. Replays queries from a server log, or generates a Zipf distributed mix of
+// exact, prefix, suffix, infix and phrase queries from the vocabulary of an ngrams.duckdb, with a fixed number of
+// concurrent clients. Reports throughput, latency percentiles and the server's timing breakdown.
+//
+//     npx tsx scripts/loadtest.ts --log log.txt --concurrency 16 --duration 30
+//     npx tsx scripts/loadtest.ts --db ngrams-1.duckdb --requests 5000
+//
+// A local database to test against can be made with the aggregator's --synthetic option. --db defaults to the published
+// database, like the server.
+
+import fs from "fs";
+import { parseArgs } from "util";
+import duckdb from "duckdb";
+
+import { encoded_query_response, query_timing } from "../shared/schema.js";
+
+type workload_query = { q: string; ci: boolean; combine: boolean };
+
+const { values: args } = parseArgs({
+    options: {
+        url: { type: "string", default: "http://localhost:9595/tccpp-ngrams/query" },
+        log: { type: "string" },
+        db: { type: "string" },
+        concurrency: { type: "string", default: "8" },
+        duration: { type: "string", default: "30" },
+        requests: { type: "string" },
+        zipf: { type: "string", default: "1.1" },
+        seed: { type: "string", default: "1" },
+    },
+});
+
+// small deterministic prng so that synthetic workloads are repeatable
+function mulberry32(seed: number) {
+    return () => {
+        seed = (seed + 0x6d2b79f5) | 0;
+        let t = Math.imul(seed ^ (seed >>> 15), 1 | seed);
+        t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t;
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+const random = mulberry32(parseInt(args.seed));
+
+function zipf_sampler(n: number, exponent: number) {
+    const cdf: number[] = [];
+    let sum = 0;
+    for (let i = 1; i <= n; i++) {
+        sum += 1 / Math.pow(i, exponent);
+        cdf.push(sum);
+    }
+    return () => {
+        const target = random() * sum;
+        let low = 0;
+        let high = n - 1;
+        while (low < high) {
+            const mid = (low + high) >> 1;
+            if (cdf[mid] < target) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    };
+}
+
+function read_log(path: string): workload_query[] {
+    const queries: workload_query[] = [];
+    for (const line of fs.readFileSync(path, "utf-8").split("\n")) {
+        const match = line.match(/Received query (".*?") ?(\{.*\})?$/);
+        if (!match) {
+            continue;
+        }
+        const options = match[2] ? JSON.parse(match[2]) : {};
+        queries.push({ q: JSON.parse(match[1]), ci: !!options.ci, combine: !!options.combine });
+    }
+    return queries;
+}
+
+function table_column(con: duckdb.Connection, query: string): Promise<string[]> {
+    return new Promise((resolve, reject) => {
+        con.all(query, (err, res) => (err ? reject(err) : resolve(res.map(row => Object.values(row).join(" ")))));
+    });
+}
+
+async function synthetic_workload(path: string, count: number): Promise<workload_query[]> {
+    const db = new duckdb.Database(path, duckdb.OPEN_READONLY);
+    const con = db.connect();
+    const order = "ORDER BY total DESC LIMIT 10000";
+    const words = await table_column(con, `SELECT gram_0 FROM ngrams_1 ${order}`);
+    const phrases = await table_column(con, `SELECT gram_0, gram_1 FROM ngrams_2 ${order}`);
+    db.close();
+    const exponent = parseFloat(args.zipf);
+    const word = zipf_sampler(words.length, exponent);
+    const phrase = zipf_sampler(phrases.length, exponent);
+    const slice = (str: string, from: number, to?: number) => Array.from(str).slice(from, to).join("");
+    const kinds: [number, () => string][] = [
+        [0.35, () => words[word()]],
+        [0.15, () => `${slice(words[word()], 0, 2)}*`],
+        [0.1, () => `*${slice(words[word()], -3)}`],
+        [0.1, () => `*${slice(words[word()], 1, 4)}*`],
+        [0.15, () => phrases[phrase()]],
+        [0.05, () => `${words[word()]} *`],
+        [0.1, () => [...Array(2 + Math.floor(random() * 4))].map(() => words[word()]).join(", ")],
+    ];
+    const queries: workload_query[] = [];
+    for (let i = 0; i < count; i++) {
+        let roll = random();
+        const kind = kinds.find(([weight]) => (roll -= weight) < 0) ?? kinds[0];
+        queries.push({ q: kind[1](), ci: random() < 0.3, combine: random() < 0.2 });
+    }
+    return queries;
+}
+
+// the database the version marker points at, falling back to an unversioned database
+function published_database() {
+    if (!fs.existsSync("ngrams.version")) {
+        return "ngrams.duckdb";
+    }
+    return `ngrams-${fs.readFileSync("ngrams.version", "utf-8").trim()}.duckdb`;
+}
+
+function percentile(sorted: number[], p: number) {
+    return sorted.length === 0 ? NaN : sorted[Math.min(sorted.length - 1, Math.floor((sorted.length * p) / 100))];
+}
+
+async function main() {
+    const request_limit = args.requests ? parseInt(args.requests) : Infinity;
+    const db_path = args.db ?? published_database();
+    const workload = args.log ? read_log(args.log) : await synthetic_workload(db_path, Math.min(request_limit, 100000));
+    if (workload.length === 0) {
+        throw new Error("Empty workload");
+    }
+    const deadline = args.requests ? Infinity : performance.now() + parseFloat(args.duration) * 1000;
+    const latencies: number[] = [];
+    const statuses = new Map<number | string, number>();
+    const totals: query_timing = { planning: 0, execution: 0, serialization: 0 };
+    let issued = 0;
+    const start = performance.now();
+    const client = async () => {
+        while (issued < request_limit && performance.now() < deadline) {
+            const { q, ci, combine } = workload[issued++ % workload.length];
+            const request_start = performance.now();
+            let status: number | string;
+            try {
+                const response = await fetch(`${args.url}?q=${encodeURIComponent(q)}&ci=${ci}&combine=${combine}`);
+                status = response.status;
+                const body = (await response.json()) as encoded_query_response;
+                if (body.timing) {
+                    totals.planning += body.timing.planning;
+                    totals.execution += body.timing.execution;
+                    totals.serialization += body.timing.serialization;
+                }
+            } catch (e) {
+                status = e instanceof Error ? e.name : "error";
+            }
+            latencies.push(performance.now() - request_start);
+            statuses.set(status, (statuses.get(status) ?? 0) + 1);
+        }
+    };
+    await Promise.all([...Array(parseInt(args.concurrency))].map(client));
+    const elapsed = (performance.now() - start) / 1000;
+    latencies.sort((a, b) => a - b);
+    const ok = statuses.get(200) ?? 0;
+    const throughput = latencies.length / elapsed;
+    console.log(`${latencies.length} requests in ${elapsed.toFixed(1)} s, ${throughput.toFixed(1)} req/s`);
+    console.log(
+        `latency ms: p50 ${percentile(latencies, 50).toFixed(1)}`,
+        `p95 ${percentile(latencies, 95).toFixed(1)}`,
+        `p99 ${percentile(latencies, 99).toFixed(1)}`,
+        `max ${latencies[latencies.length - 1].toFixed(1)}`,
+    );
+    console.log("statuses:", Object.fromEntries(statuses));
+    if (ok > 0) {
+        console.log(
+            `mean server ms (200s): planning ${(totals.planning / ok).toFixed(2)}`,
+            `execution ${(totals.execution / ok).toFixed(2)}`,
+            `serialization ${(totals.serialization / ok).toFixed(2)}`,
+        );
+    }
+}
+
+main().catch(e => {
+    console.error(e);
+    process.exit(1);
+});
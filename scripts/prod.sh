@@ -1,4 +1,6 @@
 #!/bin/bash
 
-rsync -r package.json package-lock.json tsconfig.json server shared ui scripts ngrams.duckdb server@d0:dist/tccpp-ngrams --checksum
+rsync -r package.json package-lock.json tsconfig.json server shared ui scripts server@d0:dist/tccpp-ngrams --checksum
+# the database goes before the marker, which must never point at a database that isn't fully there
+./scripts/publish.sh
 ssh server@d0 "cd dist/tccpp-ngrams && screen -XS _Tccppngrams quit; ./scripts/start.sh"
@@ -0,0 +1,11 @@
+#!/bin/bash
+
+# Ships a new database without restarting, the server switches over once it sees the new version marker
+version=$(cat ngrams.version)
+rsync ngrams-$version.duckdb server@d0:dist/tccpp-ngrams --checksum
+rsync ngrams.version server@d0:dist/tccpp-ngrams --checksum
+# like the aggregator, keep the previous version around for requests still running on it and drop everything older
+ssh server@d0 "cd dist/tccpp-ngrams && for db in ngrams-*.duckdb; do
+    old=\${db#ngrams-}; old=\${old%.duckdb}
+    if [[ \$old =~ ^[0-9]+$ ]] && (( old < $version - 1 )); then rm -f \$db \$db.wal; fi
+done"
@@ -7,10 +7,215 @@ const app = express();
 const port = process.env.PORT ? parseInt(process.env.PORT) : 9595;
 
 import duckdb from "duckdb";
-import { encoded_query_response, encoded_query_result, query_response, query_result } from "../shared/schema.js";
+import {
+    encoded_query_response,
+    encoded_query_result,
+    query_response,
+    query_result,
+    query_timing,
+    complete_response,
+} from "../shared/schema.js";
+import { max_query_parts, query_parts } from "../shared/common.js";
 import assert from "assert";
-const db = new duckdb.Database("ngrams.duckdb");
-const con = db.connect();
+import fs from "fs";
+import os from "os";
+import { is_wildcard, plan_conditions } from "./planner.js";
+import { CompletionIndex } from "./completions.js";
+import { ConnectionPool, PoolSaturatedError, QueryAbortedError, QueryTimeoutError } from "./pool.js";
+
+// every part of every request runs on its own pooled connection, one connection per core by default
+const pool_size = process.env.POOL_SIZE ? parseInt(process.env.POOL_SIZE) : os.availableParallelism();
+const max_queued = process.env.MAX_QUEUED ? parseInt(process.env.MAX_QUEUED) : pool_size * 8;
+const query_timeout_ms = process.env.QUERY_TIMEOUT_MS ? parseInt(process.env.QUERY_TIMEOUT_MS) : 10000;
+
+// The aggregator publishes each database as ngrams-<version>.duckdb and then points ngrams.version at it, databases
+// from before versioning are a plain ngrams.duckdb
+const version_marker = "ngrams.version";
+
+function read_version(): string | null {
+    try {
+        return fs.readFileSync(version_marker, "utf8").trim();
+    } catch {
+        return null;
+    }
+}
+
+function database_path(version: string | null) {
+    return version === null ? "ngrams.duckdb" : `ngrams-${version}.duckdb`;
+}
+
+// An open database and what the aggregator recorded about how it was built
+type database = {
+    version: string | null;
+    db: duckdb.Database;
+    pool: ConnectionPool;
+    // databases without metadata are 5-gram databases
+    max_width: number;
+    // whether case folded ngrams were counted into ngrams_ci_N and frequencies_ci
+    case_folded: boolean;
+    // granularity of the series table, if the database has one, in addition to the monthly frequencies table
+    series_granularity: granularity;
+    // databases predating the rank column are stored in arbitrary order and have to be sorted by total
+    has_rank: boolean;
+    // older databases don't have the gram index tables, queries fall back to plain GLOB scans
+    has_gram_indexes: boolean;
+    // autocomplete for the exact and the case folded ngrams, older databases don't have completions tables
+    completions: CompletionIndex | null;
+    completions_ci: CompletionIndex | null;
+};
+
+async function open_database(version: string | null): Promise<database> {
+    const db = await new Promise<duckdb.Database>((resolve, reject) => {
+        const db = new duckdb.Database(database_path(version), duckdb.OPEN_READONLY, err => {
+            if (err) {
+                reject(err);
+            } else {
+                resolve(db);
+            }
+        });
+    });
+    const database: database = {
+        version,
+        db,
+        pool: new ConnectionPool(db, pool_size, max_queued, query_timeout_ms),
+        max_width: 5,
+        case_folded: false,
+        series_granularity: "month",
+        has_rank: false,
+        has_gram_indexes: false,
+        completions: null,
+        completions_ci: null,
+    };
+    let completion_prefix_limit = 0;
+    try {
+        for (const { key, value } of await database.pool.all(undefined, "SELECT key, value FROM metadata")) {
+            if (key === "max_width") {
+                database.max_width = parseInt(value);
+            } else if (key === "case_folded") {
+                database.case_folded = value === "true";
+            } else if (key === "granularity" && is_granularity(value)) {
+                database.series_granularity = value;
+            } else if (key === "completion_prefix_limit") {
+                completion_prefix_limit = parseInt(value);
+            }
+        }
+        M.info(
+            "Max ngram width:",
+            database.max_width,
+            "case folded tables:",
+            database.case_folded,
+            "series:",
+            database.series_granularity,
+        );
+    } catch {
+        M.warn("Unable to read database metadata, assuming max width of", database.max_width);
+    }
+    try {
+        const res = await database.pool.all(
+            undefined,
+            "SELECT COUNT(*) AS count FROM information_schema.columns" +
+                " WHERE table_name = 'ngrams_1' AND column_name = 'rank'",
+        );
+        database.has_rank = Number(res[0].count) === 1;
+    } catch {
+        M.warn("Unable to check for the rank column");
+    }
+    try {
+        const res = await database.pool.all(
+            undefined,
+            "SELECT COUNT(*) AS count FROM information_schema.tables" +
+                " WHERE table_name IN ('gram_suffixes', 'gram_trigrams')",
+        );
+        database.has_gram_indexes = Number(res[0].count) === 2;
+        M.info("Gram indexes:", database.has_gram_indexes ? "present" : "absent");
+    } catch {
+        M.warn("Unable to check for gram indexes");
+    }
+    if (completion_prefix_limit > 0) {
+        try {
+            const start = performance.now();
+            const load = async (suffix: string, lower: (str: string) => string) =>
+                new CompletionIndex(
+                    (await database.pool.all(
+                        undefined,
+                        `SELECT width, prefix, complete, completions FROM completions${suffix}`,
+                    )) as { width: number; prefix: string; complete: boolean; completions: string[] }[],
+                    completion_prefix_limit,
+                    lower,
+                );
+            database.completions = await load("", str => str.toLowerCase());
+            if (database.case_folded) {
+                database.completions_ci = await load("_ci", fold_case);
+            }
+            M.info(
+                "Loaded",
+                database.completions.size + (database.completions_ci?.size ?? 0),
+                "completion prefixes in",
+                Math.round(performance.now() - start),
+                "ms",
+            );
+        } catch (e) {
+            M.warn("Unable to load completions", e);
+        }
+    }
+    return database;
+}
+
+let current = await open_database(read_version());
+M.info("Serving database", database_path(current.version));
+
+// Recently served queries, replayed against a newly published database before it takes over so that it starts with
+// warm caches
+const recent_queries = new Map<string, [raw_query: string, options: query_options]>();
+const max_recent_queries = 64;
+
+function remember_query(raw_query: string, options: query_options) {
+    const key = JSON.stringify([raw_query, options]);
+    recent_queries.delete(key);
+    recent_queries.set(key, [raw_query, options]);
+    if (recent_queries.size > max_recent_queries) {
+        recent_queries.delete(recent_queries.keys().next().value!);
+    }
+}
+
+async function warm_up(database: database) {
+    const start = performance.now();
+    for (const [raw_query, options] of recent_queries.values()) {
+        const timing: query_timing = { planning: 0, execution: 0, serialization: 0 };
+        // a query that fails here will fail the same way for clients
+        await handle_query(raw_query, options, new AbortController().signal, timing, database).catch(() => {});
+    }
+    M.info("Warmed up with", recent_queries.size, "recent queries in", Math.round(performance.now() - start), "ms");
+}
+
+// Requests already in flight finish on the database they started with, the old database is closed once its last
+// query is done
+async function switch_database(version: string) {
+    M.info("Opening", database_path(version));
+    const next = await open_database(version);
+    await warm_up(next);
+    const previous = current;
+    current = next;
+    M.info("Serving database", database_path(version));
+    await previous.pool.close();
+    previous.db.close();
+}
+
+// The marker is polled rather than watched, the aggregator renames a new marker over the old one. A failed switch is
+// retried on the next poll, the database might not have been fully copied yet.
+let switching = false;
+setInterval(() => {
+    const version = read_version();
+    if (switching || version === null || version === current.version) {
+        return;
+    }
+    switching = true;
+    switch_database(version)
+        .catch(e => M.error("Unable to switch to", database_path(version), e))
+        .finally(() => {
+            switching = false;
+        });
+}, 5000);
 
 // rudimentary but all that is needed at the moment
 function tokenize(part: string) {
@@ -23,40 +228,95 @@ class QueryError extends Error {
     }
 }
 
+type granularity = "month" | "week" | "day";
+
+function is_granularity(value: unknown): value is granularity {
+    return value === "month" || value === "week" || value === "day";
+}
+
 type query_options = {
     case_insensitive: boolean;
     combine: boolean;
+    granularity: granularity;
 };
 
-function formulate_query(part: string[], options: query_options): [query: string, ...params: (string | number)[]] {
-    const column_names = [...part.map((_, i) => `gram_${i}`)];
-    const conditions = column_names.map(column =>
-        options.case_insensitive
-            ? `LOWER(ngrams_${column_names.length}.${column}) GLOB ?`
-            : `ngrams_${column_names.length}.${column} GLOB ?`,
+// Source of (ngram_id, time, frequency) rows for the top ngrams. Weekly and daily series are stored as one row per
+// ngram with delta encoded bucket lists, the buckets are recovered with a running sum over the unnested deltas.
+function series_source(suffix: string, granularity: granularity) {
+    if (granularity === "month") {
+        return { source: `frequencies${suffix}`, time: "months_since_epoch" };
+    }
+    return {
+        source: `(
+                SELECT ngram_id, SUM(delta) OVER (PARTITION BY ngram_id ORDER BY position) AS bucket, frequency
+                FROM (
+                    SELECT
+                        ngram_id,
+                        unnest(bucket_deltas) AS delta,
+                        unnest(frequencies) AS frequency,
+                        generate_subscripts(bucket_deltas, 1) AS position
+                    FROM series${suffix}
+                    WHERE ngram_id IN (SELECT ngram_id FROM top_ngrams)
+                )
+            )`,
+        time: "bucket",
+    };
+}
+
+// The aggregator's fold_case is generated to match this, see scripts/case_folding_table.py
+function fold_case(str: string) {
+    return str.toLowerCase().replace(/ς/g, "σ").replace(/ſ/g, "s");
+}
+
+// The condition on ngrams_N rows matching a part
+function part_condition(part: string[], options: query_options, database: database) {
+    assert(part.length <= database.max_width);
+    // with case folded tables a case insensitive query is a plain lookup of the folded pattern
+    const folded = options.case_insensitive && database.case_folded;
+    const suffix = folded ? "_ci" : "";
+    const { conditions, params } = plan_conditions(
+        part.map(s => (folded ? fold_case(s) : options.case_insensitive ? s.toLocaleLowerCase() : s)),
+        part.length,
+        options.case_insensitive && !folded,
+        database.has_gram_indexes,
+        suffix,
     );
+    return { suffix, where: conditions.length > 0 ? conditions.join(" AND ") : "TRUE", params };
+}
+
+function formulate_query(
+    part: string[],
+    options: query_options,
+    database: database,
+): [query: string, ...params: (string | number)[]] {
+    const column_names = [...part.map((_, i) => `gram_${i}`)];
+    const { suffix, where, params } = part_condition(part, options, database);
+    const ngrams_table = `ngrams${suffix}_${column_names.length}`;
+    // ngrams_N is stored in rank order, top-k can stop early rather than sorting every match
+    const order = database.has_rank ? "rank" : "total DESC";
+    const { source, time } = series_source(suffix, options.granularity);
     if (options.combine) {
         return [
             `
             WITH top_ngrams AS (
                 SELECT ngram_id
-                FROM ngrams_${column_names.length}
+                FROM ${ngrams_table}
                 WHERE
-                    ${conditions.join(" AND ")}
-                ORDER BY total DESC
+                    ${where}
+                ORDER BY ${order}
                 LIMIT 10
             )
             SELECT
                 ${part.map((_, i) => `? as gram_${i}`).join(", ")},
-                frequencies.months_since_epoch,
+                frequencies.${time},
                 SUM(frequencies.frequency) as frequency
-            FROM frequencies
+            FROM ${source} AS frequencies
             INNER JOIN top_ngrams ON top_ngrams.ngram_id = frequencies.ngram_id
-            GROUP BY frequencies.months_since_epoch
-            ORDER BY frequencies.months_since_epoch
+            GROUP BY frequencies.${time}
+            ORDER BY frequencies.${time}
             ;
             `,
-            ...part.map(s => (options.case_insensitive ? s.toLocaleLowerCase() : s)),
+            ...params,
             ...part,
         ];
     } else {
@@ -64,99 +324,270 @@ function formulate_query(part: string[], options: query_options): [query: string
             `
             WITH top_ngrams AS (
                 SELECT ngram_id, ${column_names.join(", ")}
-                FROM ngrams_${column_names.length}
+                FROM ${ngrams_table}
                 WHERE
-                    ${conditions.join(" AND ")}
-                ORDER BY total DESC
+                    ${where}
+                ORDER BY ${order}
                 LIMIT 10
             )
             SELECT
                 ${column_names.map(column => `top_ngrams.${column}`).join(", ")},
-                frequencies.months_since_epoch,
+                frequencies.${time},
                 frequencies.frequency
-            FROM frequencies
+            FROM ${source} AS frequencies
             INNER JOIN top_ngrams ON top_ngrams.ngram_id = frequencies.ngram_id
-            ORDER BY ${column_names.map(column => `top_ngrams.${column}`).join(", ")}, frequencies.months_since_epoch;
+            ORDER BY ${column_names.map(column => `top_ngrams.${column}`).join(", ")}, frequencies.${time};
             `,
-            ...part.map(s => (options.case_insensitive ? s.toLocaleLowerCase() : s)),
+            ...params,
         ];
     }
 }
 
-function do_query(tokenized_part: string[], options: query_options): Promise<query_result> {
-    return new Promise<query_result>((resolve, reject) => {
-        const data: query_result = new Map();
-        assert(tokenized_part.length <= 5);
-        const [query, ...params] = formulate_query(tokenized_part, options);
-        // console.log(query);
-        con.all(query, ...params, (err, res) => {
-            if (err) {
-                reject(err);
-                return;
-            }
-            // eslint-disable-next-line @typescript-eslint/no-unnecessary-condition
-            if (res === undefined) {
-                reject(new Error("Internal error"));
-                return;
-            }
-            for (const row of res) {
-                const ngram = [...Array(tokenized_part.length).keys()].map(i => row[`gram_${i}`]).join(" ");
-                if (!data.has(ngram)) {
-                    data.set(ngram, []);
-                }
-                data.get(ngram)!.push({
-                    year_month: Date.UTC(2017, row.months_since_epoch),
-                    frequency: row.frequency,
-                });
-            }
-            resolve(data);
+// Parts of the same width share one scan of ngrams_N: each part's condition becomes a flag on the rows matching any of
+// them, every part's top ngrams are picked from those and the frequencies are joined once. Rows are tagged with the
+// index of their part in the group, an ngram matching several parts comes back once for each. Only worth it for parts
+// that have to scan to the end anyway, see handle_query.
+function formulate_shared_query(
+    parts: string[][],
+    options: query_options,
+    database: database,
+): [query: string, ...params: (string | number)[]] {
+    const width = parts[0].length;
+    assert(parts.every(part => part.length === width));
+    const column_names = [...Array(width).keys()].map(i => `gram_${i}`);
+    const planned = parts.map(part => part_condition(part, options, database));
+    const suffix = planned[0].suffix;
+    const flags = planned.map((_, i) => `part_${i}`);
+    const order = database.has_rank ? "rank" : "total DESC";
+    const { source, time } = series_source(suffix, options.granularity);
+    const top_ngrams = flags
+        .map(
+            (flag, i) => `
+                SELECT * FROM (
+                    SELECT ${i} AS part, ngram_id, ${column_names.join(", ")}
+                    FROM candidates
+                    WHERE ${flag}
+                    ORDER BY ${order}
+                    LIMIT 10
+                )`,
+        )
+        .join(" UNION ALL ");
+    const ctes = `
+            WITH candidates AS MATERIALIZED (
+                SELECT *
+                FROM (
+                    SELECT
+                        ngram_id,
+                        ${column_names.join(", ")},
+                        ${database.has_rank ? "rank" : "total"},
+                        ${planned.map(({ where }, i) => `(${where}) AS ${flags[i]}`).join(",\n")}
+                    FROM ngrams${suffix}_${width}
+                )
+                WHERE ${flags.join(" OR ")}
+            ),
+            top_ngrams AS (${top_ngrams}
+            )`;
+    const params = planned.flatMap(({ params }) => params);
+    const qualified_columns = column_names.map(column => `top_ngrams.${column}`).join(", ");
+    if (options.combine) {
+        return [
+            `${ctes}
+            SELECT top_ngrams.part, frequencies.${time}, SUM(frequencies.frequency) as frequency
+            FROM ${source} AS frequencies
+            INNER JOIN top_ngrams ON top_ngrams.ngram_id = frequencies.ngram_id
+            GROUP BY top_ngrams.part, frequencies.${time}
+            ORDER BY top_ngrams.part, frequencies.${time};
+            `,
+            ...params,
+        ];
+    } else {
+        return [
+            `${ctes}
+            SELECT top_ngrams.part, ${qualified_columns}, frequencies.${time}, frequencies.frequency
+            FROM ${source} AS frequencies
+            INNER JOIN top_ngrams ON top_ngrams.ngram_id = frequencies.ngram_id
+            ORDER BY top_ngrams.part, ${qualified_columns}, frequencies.${time};
+            `,
+            ...params,
+        ];
+    }
+}
+
+const day_ms = 24 * 60 * 60 * 1000;
+
+// A combined series is labelled with its part, shared queries don't return the part's grams
+function to_query_result(
+    tokenized_part: string[],
+    res: duckdb.TableData,
+    granularity: granularity,
+    label?: string,
+): query_result {
+    const data: query_result = new Map();
+    // buckets are whole days or weeks since the start of 2017
+    const bucket_ms = granularity === "week" ? 7 * day_ms : day_ms;
+    for (const row of res) {
+        const ngram = label ?? [...Array(tokenized_part.length).keys()].map(i => row[`gram_${i}`]).join(" ");
+        if (!data.has(ngram)) {
+            data.set(ngram, []);
+        }
+        data.get(ngram)!.push({
+            year_month:
+                granularity === "month"
+                    ? Date.UTC(2017, row.months_since_epoch)
+                    : Date.UTC(2017, 0) + Number(row.bucket) * bucket_ms,
+            frequency: row.frequency,
         });
-    });
+    }
+    return data;
 }
 
-async function handle_query(raw_query: string, options: query_options): Promise<query_response> {
-    const parts = raw_query
-        .split(",")
-        .map(q => q.trim())
-        .filter(q => q !== "")
-        .map(tokenize);
+async function handle_query(
+    raw_query: string,
+    options: query_options,
+    signal: AbortSignal,
+    timing: query_timing,
+    database: database,
+): Promise<query_response> {
+    let phase_start = performance.now();
+    const parts = query_parts(raw_query).map(tokenize);
     // verifications
-    if (parts.length > 10) {
-        throw new QueryError("Query has too many parts (max 10)");
+    if (parts.length > max_query_parts) {
+        throw new QueryError(`Query has too many parts (max ${max_query_parts})`);
+    }
+    if (options.granularity !== "month" && options.granularity !== database.series_granularity) {
+        throw new QueryError(`This database doesn't have ${options.granularity} series`);
     }
     for (const part of parts) {
-        if (part.length > 5) {
+        if (part.length > database.max_width) {
             throw new QueryError(`Query part "${part.join(" ")}" has too many words`);
         }
     }
+    // Parts without wildcards match a handful of rows at most, their top-k never fills up early and each would scan
+    // all of ngrams_N, so those of the same width share one scan. A wildcard part usually stops after its first few
+    // matches in rank order and keeps its own query.
+    const groups = new Map<string, number[]>();
+    for (const [i, part] of parts.entries()) {
+        const key = part.some(is_wildcard) ? `part ${i}` : `width ${part.length}`;
+        groups.set(key, [...(groups.get(key) ?? []), i]);
+    }
+    const queries = [...groups.values()].map(indices => ({
+        indices,
+        query:
+            indices.length === 1
+                ? formulate_query(parts[indices[0]], options, database)
+                : formulate_shared_query(indices.map(i => parts[i]), options, database),
+    }));
+    timing.planning = performance.now() - phase_start;
     // actual query
-    const data = await Promise.all(parts.map(part => do_query(part, options)));
+    phase_start = performance.now();
+    const results = await Promise.all(
+        queries.map(({ query: [query, ...params] }) => database.pool.all(signal, query, ...params)),
+    );
+    timing.execution = performance.now() - phase_start;
+    phase_start = performance.now();
+    const data: query_response = new Array(parts.length);
+    for (const [i, { indices }] of queries.entries()) {
+        if (indices.length === 1) {
+            data[indices[0]] = to_query_result(parts[indices[0]], results[i], options.granularity);
+            continue;
+        }
+        // demultiplex the shared query's rows by part
+        const rows: duckdb.RowData[][] = indices.map(() => []);
+        for (const row of results[i]) {
+            rows[row.part].push(row);
+        }
+        for (const [j, index] of indices.entries()) {
+            const label = options.combine ? parts[index].join(" ") : undefined;
+            data[index] = to_query_result(parts[index], rows[j], options.granularity, label);
+        }
+    }
+    timing.serialization = performance.now() - phase_start;
     return data;
 }
 
+// Completions of the last part of a query, the part's word count picks the width. Served from memory without touching
+// the pool, these are requested on every keystroke.
+app.get("/tccpp-ngrams/complete", (req, res) => {
+    const raw_query = req.query.q;
+    if (!is_string(raw_query)) {
+        res.status(500);
+        res.end();
+        return;
+    }
+    const database = current;
+    const folded = req.query.ci === "true" && database.case_folded;
+    const index = folded ? database.completions_ci : database.completions;
+    const part = raw_query.slice(raw_query.lastIndexOf(",") + 1).trimStart();
+    const words = tokenize(part);
+    // a trailing space starts the next word
+    const width = words.length + (words.length > 0 && /\s$/.test(part) ? 1 : 0);
+    const response: complete_response = { completions: [] };
+    // globs aren't completed, they're already a search
+    if (index !== null && words.length > 0 && width <= database.max_width && !/[*?[\\]/.test(part)) {
+        response.completions = index.lookup(width, words.join(" ") + (width > words.length ? " " : ""));
+    }
+    res.json(response);
+});
+
 app.get("/tccpp-ngrams/query", (req, res) => {
     const raw_query = req.query.q;
     const case_insensitive = req.query.ci === "true";
     const combine = req.query.combine === "true";
-    M.log("Received query", JSON.stringify(raw_query));
+    const granularity = is_granularity(req.query.granularity) ? req.query.granularity : "month";
+    // logged with its options so that the log can be replayed by scripts/loadtest.ts
+    M.log("Received query", JSON.stringify(raw_query), JSON.stringify({ ci: case_insensitive, combine, granularity }));
     if (!is_string(raw_query)) {
         M.error("Query isn't a string");
         res.status(500);
         res.end();
     } else {
         const start = Date.now();
-        handle_query(raw_query, { case_insensitive, combine })
+        // parts of a request the client gave up on are dropped from the pool's queue
+        const controller = new AbortController();
+        res.on("close", () => {
+            if (!res.writableFinished) {
+                controller.abort();
+            }
+        });
+        const timing: query_timing = { planning: 0, execution: 0, serialization: 0 };
+        const options: query_options = { case_insensitive, combine, granularity };
+        // the whole request runs against one database even if a new one is published meanwhile
+        const database = current;
+        handle_query(raw_query, options, controller.signal, timing, database)
             .then((data: query_response) => {
                 M.debug("Finished query");
+                remember_query(raw_query, options);
+                const serialization_start = performance.now();
+                const series = JSON.stringify(data.map(result => Array.from(result)) as encoded_query_result[]);
+                timing.serialization += performance.now() - serialization_start;
                 res.setHeader("Content-Type", "application/json");
+                // the series are encoded up front so their cost shows up in the timing breakdown
                 res.end(
-                    JSON.stringify({
-                        series: data.map(result => Array.from(result)) as encoded_query_result[],
-                        time: Date.now() - start,
-                    } as encoded_query_response),
+                    `{"series":${series},"time":${Date.now() - start},"timing":${JSON.stringify(timing)},` +
+                        `"version":${JSON.stringify(database.version)}}`,
                 );
             })
             .catch(e => {
+                // the request has failed as a whole, its other parts shouldn't keep holding or waiting for connections
+                controller.abort();
+                if (e instanceof QueryAbortedError) {
+                    // the client went away, superseded queries from the UI are routine
+                    M.debug("Query cancelled");
+                    res.end();
+                    return;
+                }
+                if (e instanceof PoolSaturatedError || e instanceof QueryTimeoutError) {
+                    M.warn(e.message, database.pool.stats);
+                    res.status(e instanceof PoolSaturatedError ? 503 : 504);
+                    res.end(
+                        JSON.stringify({
+                            series: [],
+                            time: Date.now() - start,
+                            error: e.message,
+                        } as encoded_query_response),
+                    );
+                    return;
+                }
                 res.status(500);
                 if (e instanceof QueryError) {
                     M.debug("QueryError:", e.message);
@@ -0,0 +1,56 @@
+// Prefix autocomplete from the aggregator's completions tables, kept entirely in memory. The aggregator stores the top
+// completions of a prefix only while the prefix's parent had more matches than fit in a list, a prefix that isn't
+// stored is answered by filtering the list of its longest stored prefix.
+
+type completion_node = {
+    // the list has every match of the prefix rather than just the top ones
+    complete: boolean;
+    completions: string[];
+};
+
+export class CompletionIndex {
+    // one map per width, keyed by the lowercased prefix
+    private nodes: Map<string, completion_node>[] = [];
+
+    constructor(
+        rows: { width: number; prefix: string; complete: boolean; completions: string[] }[],
+        private prefix_limit: number,
+        private lower: (str: string) => string,
+    ) {
+        for (const { width, prefix, complete, completions } of rows) {
+            while (this.nodes.length <= width) {
+                this.nodes.push(new Map());
+            }
+            this.nodes[width].set(prefix, { complete, completions });
+        }
+    }
+
+    get size() {
+        return this.nodes.reduce((size, nodes) => size + nodes.size, 0);
+    }
+
+    lookup(width: number, prefix: string): string[] {
+        const nodes = this.nodes.at(width);
+        if (nodes === undefined) {
+            return [];
+        }
+        const lowered = this.lower(prefix);
+        const chars = Array.from(lowered);
+        for (let length = Math.min(chars.length, this.prefix_limit); length > 0; length--) {
+            const node = nodes.get(chars.slice(0, length).join(""));
+            if (node === undefined) {
+                continue;
+            }
+            if (length === chars.length) {
+                return node.completions;
+            }
+            // a longer prefix of an incomplete node would have been stored if anything matched it, unless it's past
+            // the limit in which case the top completions are the best there is
+            if (!node.complete && length < this.prefix_limit) {
+                return [];
+            }
+            return node.completions.filter(completion => this.lower(completion).startsWith(lowered));
+        }
+        return [];
+    }
+}
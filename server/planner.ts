@@ -0,0 +1,138 @@
+// Query planning for the GLOB patterns users type for each gram. A GLOB on its own has to be evaluated against every
+// row of ngrams_N, which is especially bad for leading wildcards. The aggregator emits a couple of index tables over
+// the vocabulary (every gram of a surviving ngram is also in ngrams_1) and the planner picks the most selective gram
+// position and narrows it down to candidate grams before the main table is filtered.
+
+export type planned_conditions = {
+    conditions: string[];
+    params: string[];
+};
+
+type index_choice = {
+    score: number;
+    condition: string;
+    params: string[];
+};
+
+// Patterns with escapes or character classes are only partially analyzed
+function analyzable_prefix(pattern: string) {
+    const end = pattern.search(/[[\\]/);
+    return end === -1 ? pattern : pattern.slice(0, end) + "*";
+}
+
+export function is_wildcard(pattern: string) {
+    return /[*?[\\]/.test(pattern);
+}
+
+function ascii_lower(str: string) {
+    return str.replace(/[A-Z]/g, c => c.toLowerCase());
+}
+
+// Trigrams of literal runs in the pattern, as they'd appear in gram_trigrams. Only all-ASCII trigrams are used: the
+// index is built with duckdb's unicode aware lower() and other characters might not lowercase the same way here.
+function pattern_trigrams(pattern: string) {
+    const trigrams = new Set<string>();
+    for (const segment of analyzable_prefix(pattern).split(/[*?]/)) {
+        const chars = Array.from(ascii_lower(segment));
+        for (let i = 0; i + 3 <= chars.length; i++) {
+            const trigram = chars.slice(i, i + 3).join("");
+            if (/^[\x20-\x7e]{3}$/.test(trigram)) {
+                trigrams.add(trigram);
+            }
+        }
+    }
+    return [...trigrams];
+}
+
+function literal_prefix_length(pattern: string) {
+    const end = pattern.search(/[*?[\\]/);
+    return Array.from(end === -1 ? pattern : pattern.slice(0, end)).length;
+}
+
+function literal_suffix_length(pattern: string) {
+    if (/[[\\]/.test(pattern)) {
+        return 0;
+    }
+    const start = Math.max(pattern.lastIndexOf("*"), pattern.lastIndexOf("?")) + 1;
+    return Array.from(pattern.slice(start)).length;
+}
+
+// Best index for a single wildcard pattern on a column, if any is worth using
+function choose_index(column: string, pattern: string, width: number, case_insensitive: boolean, suffix: string) {
+    const choices: index_choice[] = [];
+    // the vocabulary is ngrams_1 itself, narrowing through it only helps for wider tables
+    const prefix_length = literal_prefix_length(pattern);
+    if (width > 1 && prefix_length > 0) {
+        choices.push({
+            score: prefix_length,
+            condition: `${column} IN (SELECT gram_0 FROM ngrams${suffix}_1 WHERE ${
+                case_insensitive ? "LOWER(gram_0)" : "gram_0"
+            } GLOB ?)`,
+            params: [pattern],
+        });
+    }
+    const suffix_length = literal_suffix_length(pattern);
+    if (suffix_length > 0) {
+        choices.push({
+            score: suffix_length,
+            condition: `${column} IN (SELECT gram FROM gram_suffixes${suffix} WHERE ${
+                case_insensitive ? "gram_reversed_lower" : "gram_reversed"
+            } GLOB reverse(?))`,
+            params: [pattern],
+        });
+    }
+    const trigrams = pattern_trigrams(pattern);
+    if (trigrams.length > 0) {
+        choices.push({
+            score: trigrams.length + 2,
+            condition: `${column} IN (
+                SELECT gram FROM gram_trigrams${suffix}
+                WHERE trigram IN (${trigrams.map(() => "?").join(", ")})
+                GROUP BY gram
+                HAVING COUNT(*) = ${trigrams.length}
+            )`,
+            params: trigrams,
+        });
+    }
+    // a single literal character doesn't narrow things down enough to be worth the extra join
+    return choices.filter(choice => choice.score >= 2).sort((a, b) => b.score - a.score).at(0);
+}
+
+// Conditions for matching the given patterns, one per gram, against ngrams{suffix}_{width}. Patterns are expected to
+// already be lowercased for case insensitive queries.
+export function plan_conditions(
+    patterns: string[],
+    width: number,
+    case_insensitive: boolean,
+    use_indexes: boolean,
+    suffix = "",
+): planned_conditions {
+    const table = `ngrams${suffix}_${width}`;
+    const columns = patterns.map((_, i) => `${table}.gram_${i}`);
+    const targets = columns.map(column => (case_insensitive ? `LOWER(${column})` : column));
+    const conditions: string[] = [];
+    const params: string[] = [];
+    // the driving index goes first, it's what narrows things down. An exact gram is already as selective as it gets.
+    if (use_indexes && patterns.every(is_wildcard)) {
+        const best = patterns
+            .map((pattern, i) => choose_index(columns[i], pattern, width, case_insensitive, suffix))
+            .filter((choice): choice is index_choice => choice !== undefined)
+            .sort((a, b) => b.score - a.score)
+            .at(0);
+        if (best) {
+            conditions.push(best.condition);
+            params.push(...best.params);
+        }
+    }
+    // exact grams first since they're the cheapest and most selective, then the remaining patterns
+    for (const exact of [true, false]) {
+        patterns.forEach((pattern, i) => {
+            if (/^\*+$/.test(pattern) || is_wildcard(pattern) === exact) {
+                return;
+            }
+            conditions.push(exact ? `${targets[i]} = ?` : `${targets[i]} GLOB ?`);
+            params.push(pattern);
+        });
+    }
+    return { conditions, params };
+}
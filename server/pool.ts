@@ -0,0 +1,152 @@
+import duckdb from "duckdb";
+
+export class PoolSaturatedError extends Error {
+    constructor() {
+        super("Server is busy, try again shortly");
+    }
+}
+
+export class QueryTimeoutError extends Error {
+    constructor() {
+        super("Query took too long");
+    }
+}
+
+// A queued query whose request was cancelled before it got a connection
+export class QueryAbortedError extends Error {
+    constructor() {
+        super("Query was cancelled");
+    }
+}
+
+type waiter = {
+    resolve: (con: duckdb.Connection) => void;
+    reject: (e: Error) => void;
+};
+
+// Fixed set of connections to a read-only database. Queries beyond the pool size wait in a bounded queue and are
+// rejected outright once that is full, so that a burst of expensive queries can't pile up without bound. A query that
+// timed out keeps its connection until duckdb is actually done with it, so it still counts against the pool size.
+export class ConnectionPool {
+    private idle: duckdb.Connection[] = [];
+    private queue: waiter[] = [];
+    private timed_out = 0; // connections still running a query whose caller was already told it timed out
+    private closed = false;
+    private on_drained?: () => void;
+
+    constructor(
+        db: duckdb.Database,
+        private size: number,
+        private max_queued: number,
+        private timeout_ms: number,
+    ) {
+        for (let i = 0; i < size; i++) {
+            this.idle.push(db.connect());
+        }
+    }
+
+    private acquire(signal?: AbortSignal): Promise<duckdb.Connection> {
+        if (this.closed) {
+            return Promise.reject(new Error("Connection pool is closed"));
+        }
+        if (signal?.aborted) {
+            return Promise.reject(new QueryAbortedError());
+        }
+        const con = this.idle.pop();
+        if (con) {
+            return Promise.resolve(con);
+        }
+        // with every connection stuck on abandoned queries there's no telling when a queued query would run
+        if (this.queue.length >= this.max_queued || this.timed_out === this.size) {
+            return Promise.reject(new PoolSaturatedError());
+        }
+        return new Promise((resolve, reject) => {
+            // a request that goes away while still queued never takes a connection
+            const on_abort = () => {
+                const index = this.queue.indexOf(entry);
+                if (index !== -1) {
+                    this.queue.splice(index, 1);
+                    reject(new QueryAbortedError());
+                }
+            };
+            const entry: waiter = {
+                resolve: con => {
+                    signal?.removeEventListener("abort", on_abort);
+                    resolve(con);
+                },
+                reject,
+            };
+            this.queue.push(entry);
+            signal?.addEventListener("abort", on_abort, { once: true });
+        });
+    }
+
+    private release(con: duckdb.Connection) {
+        const next = this.queue.shift();
+        if (next) {
+            next.resolve(con);
+        } else {
+            this.idle.push(con);
+            this.check_drained();
+        }
+    }
+
+    private check_drained() {
+        if (this.on_drained && this.idle.length === this.size) {
+            for (const con of this.idle) {
+                con.close();
+            }
+            this.idle = [];
+            this.on_drained();
+        }
+    }
+
+    // Stops taking new queries and closes the connections once everything already running or queued is done
+    close(): Promise<void> {
+        this.closed = true;
+        return new Promise(resolve => {
+            this.on_drained = resolve;
+            this.check_drained();
+        });
+    }
+
+    // Runs a query on the next free connection. The returned promise rejects once the timeout elapses, however
+    // duckdb-node can't interrupt a single connection so the connection only returns to the pool when the query is
+    // actually done.
+    async all(
+        signal: AbortSignal | undefined,
+        query: string,
+        ...params: (string | number)[]
+    ): Promise<duckdb.TableData> {
+        const con = await this.acquire(signal);
+        return new Promise((resolve, reject) => {
+            let timed_out = false;
+            const timeout = setTimeout(() => {
+                timed_out = true;
+                this.timed_out++;
+                reject(new QueryTimeoutError());
+            }, this.timeout_ms);
+            con.all(query, ...params, (err, res) => {
+                clearTimeout(timeout);
+                if (timed_out) {
+                    this.timed_out--;
+                }
+                this.release(con);
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(res);
+                }
+            });
+        });
+    }
+
+    get stats() {
+        return {
+            idle: this.idle.length,
+            busy: this.size - this.idle.length,
+            timed_out: this.timed_out,
+            queued: this.queue.length,
+        };
+    }
+}
@@ -1,6 +1,16 @@
 export const first_bucket: [number, number] = [2017, 6]; // july 2017
 export const last_bucket: [number, number] = [2024, 8]; // september 2024
 
+export const max_query_parts = 10;
+
+// The comma separated parts of a query, each is queried independently
+export function query_parts(raw_query: string) {
+    return raw_query
+        .split(",")
+        .map(part => part.trim())
+        .filter(part => part !== "");
+}
+
 export function maybe_slash(str: string) {
     return str.endsWith("/") ? str : str + "/";
 }
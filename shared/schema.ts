@@ -2,8 +2,15 @@ export type entry = { year_month: number; frequency: number };
 export type query_result = Map<string, entry[]>;
 export type query_response = query_result[];
 export type encoded_query_result = [string, entry[]][];
+// milliseconds spent server-side in each phase of a query
+export type query_timing = { planning: number; execution: number; serialization: number };
 export type encoded_query_response = {
     series: encoded_query_result[];
     time: number;
+    timing?: query_timing;
     error?: string;
+    // the database that answered, results from an older version are stale once a new one is published
+    version?: string | null;
 };
+// completions of the last part of a query, best first
+export type complete_response = { completions: string[] };
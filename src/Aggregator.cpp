@@ -5,16 +5,22 @@
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
+#include <fstream>
 #include <ranges>
 #include <stdexcept>
+#include <tuple>
+#include <vector>
 
 #include "constants.hpp"
-#include "MessageDatabaseReader.hpp"
-#include "MessageDatabaseManager.hpp"
+#include "MessageSource.hpp"
+#include "ngram_io.hpp"
+#include "partial_aggregate.hpp"
 #include "tokenization.hpp"
 #include "utils.hpp"
 #include "utils/sha.hpp"
+#include "utils/case_folding.hpp"
 #include "utils/random.hpp"
+#include "utils/serialization.hpp"
 
 #include <fmt/chrono.h>
 #include <fmt/format.h>
@@ -24,12 +30,16 @@
 #include <openssl/evp.h>
 #include <xoshiro-cpp/XoshiroCpp.hpp>
 
+// Reads messages up to the end of the reader or of the range, whichever comes first
 template<typename C>
-void process_messages(MessageDatabaseReader& reader, const C& callback) {
+void process_messages(MessageReader& reader, const C& callback, std::optional<sys_ms> end = std::nullopt) {
     sys_ms last_timestamp{};
     std::uint64_t processed = 0;
     while(auto entry = reader.read()) {
         const auto& [timestamp, content] = *entry;
+        if(end && timestamp >= *end) {
+            break;
+        }
         ASSERT(timestamp >= last_timestamp, "Time went backwards");
         last_timestamp = timestamp;
         callback(timestamp, content);
@@ -40,108 +50,826 @@ void process_messages(MessageDatabaseReader& reader, const C& callback) {
     }
 }
 
+std::chrono::year_month to_year_month(sys_ms timestamp) {
+    auto date = std::chrono::year_month_day(std::chrono::floor<std::chrono::days>(timestamp));
+    return std::chrono::year_month(date.year(), date.month());
+}
+
+sys_ms month_start(std::chrono::year_month month) {
+    return std::chrono::sys_days(month / 1);
+}
+
+// open ends of partial aggregate ranges are stored as the extremes
+std::string range_bound(sys_ms bound) {
+    if(bound == sys_ms::min()) {
+        return "the start";
+    } else if(bound == sys_ms::max()) {
+        return "the end";
+    }
+    return fmt::format("{}", bound);
+}
+
 void Aggregator::run() {
-    spdlog::info("Preprocessing");
-    preprocess();
-    spdlog::info("Finished preprocessing");
+    std::optional<std::pair<phase, std::chrono::year_month>> checkpoint;
+    if(options.resume) {
+        checkpoint = load_checkpoint();
+    } else {
+        if(std::filesystem::exists(checkpoint_path)) {
+            std::filesystem::remove(checkpoint_path);
+        }
+        std::filesystem::remove_all(spill_directory);
+    }
 
-    spdlog::info("Preparing ngram maps");
-    setup_ngram_maps();
+    if(!checkpoint || checkpoint->first == phase::preprocess) {
+        spdlog::info("Preprocessing");
+        preprocess(checkpoint.transform([](const auto& checkpoint) { return month_start(checkpoint.second); }));
+        spdlog::info("Finished preprocessing");
+        if(options.checkpoint_interval != 0) {
+            write_checkpoint(phase::preprocessed, agg_epoch);
+        }
+    }
 
-    spdlog::info("Preparing db");
-    setup_database();
-    spdlog::info("Populating ngram tables");
-    populate_ngram_tables();
+    std::optional<sys_ms> aggregation_resume_from;
+    if(!checkpoint || checkpoint->first != phase::aggregation) {
+        spdlog::info("Preparing ngram maps");
+        for(auto* set : count_sets()) {
+            setup_ngram_maps(*set);
+        }
+        spdlog::info("Count map memory: {}", memory_report());
+
+        spdlog::info("Preparing db");
+        setup_database(std::nullopt);
+        spdlog::info("Populating ngram tables");
+        for(auto* set : count_sets()) {
+            populate_ngram_tables(*set);
+        }
+        spdlog::info("Creating gram indexes");
+        for(auto* set : count_sets()) {
+            create_gram_indexes(*set);
+            create_completions(*set);
+        }
+    } else {
+        spdlog::info("Reopening db");
+        setup_database(checkpoint->second);
+        aggregation_resume_from = month_start(checkpoint->second);
+    }
 
     spdlog::info("Aggregating");
-    do_aggregation();
+    do_aggregation(aggregation_resume_from);
+    if(options.granularity != bucket_granularity::month) {
+        spdlog::info("Building series");
+        for(const auto* set : count_sets()) {
+            build_series(*set);
+        }
+    }
 
+    publish_database();
+    if(std::filesystem::exists(checkpoint_path)) {
+        std::filesystem::remove(checkpoint_path);
+    }
     spdlog::info("Finished");
 }
 
-void Aggregator::preprocess() {
-    // TODO: The preprocessed_counts map here is absolutely massive, many GiB's. This is something worth
-    // reconsidering later, e.g. by trimming periodically or by using some streaming setup to better estimate
-    // the ngrams we care about.
-    auto reader = db.make_message_database_reader();
-    process_messages(reader, [&](sys_ms timestamp, std::string_view content) {
+// Counts like the first pass but keeps every ngram and its counts per month, nothing can be thresholded until all the
+// ranges are combined. Each month's counts are written out as sorted runs at the month boundary, at the end the runs
+// are merged into the partial aggregate. A failed worker is retried by running it again, the partial aggregate only
+// appears once complete.
+void Aggregator::run_partial(const std::filesystem::path& path, std::optional<sys_ms> from, std::optional<sys_ms> to) {
+    if(options.granularity != bucket_granularity::month || options.prune_interval != 0) {
+        throw std::runtime_error("Partial aggregates only support exact monthly counts");
+    }
+    auto runs_directory = std::filesystem::path(path).concat(".runs");
+    std::filesystem::remove_all(runs_directory);
+    std::filesystem::create_directories(runs_directory);
+    auto run_path = [&](const count_set& set, std::size_t width, std::int32_t month) {
+        return runs_directory / fmt::format("{}-grams{}.{}.run", width, set.suffix, month);
+    };
+    std::vector<std::int32_t> months;
+    auto write_month_runs = [&](std::chrono::year_month year_month) {
+        auto month = std::int32_t((year_month - agg_epoch).count());
+        months.push_back(month);
+        indexinator<ngram_max_width>([&] <auto I> {
+            for(auto* set : count_sets()) {
+                auto& map = std::get<I>(set->preprocessed_counts);
+                write_run<I + 1>(run_path(*set, I + 1, month), map);
+                map = counts_map<I + 1>();
+            }
+            packed_ngram<I + 1>::arena().reset();
+        });
+    };
+
+    spdlog::info(
+        "Counting partial aggregate from {} to {}",
+        range_bound(from.value_or(sys_ms::min())),
+        range_bound(to.value_or(sys_ms::max()))
+    );
+    std::optional<std::chrono::year_month> last_year_month;
+    auto reader = db->make_reader(from, to);
+    process_messages(
+        *reader,
+        [&](sys_ms timestamp, std::string_view content) {
+            if(blacklisted_timestamp(timestamp)) {
+                return;
+            }
+            auto year_month = to_year_month(timestamp);
+            if(last_year_month && year_month != *last_year_month) {
+                write_month_runs(*last_year_month);
+            }
+            last_year_month = year_month;
+            for_each_message_set(content, [&](count_set& set, std::string_view content) {
+                tokenize(content, [&](const ngram_window& ngram) {
+                    indexinator<ngram_max_width>([&] <auto I> {
+                        if(auto value = ngram.subview<I + 1>()) {
+                            std::get<I>(set.preprocessed_counts).try_emplace(*value, 0).first->second++;
+                        }
+                    });
+                });
+            });
+        },
+        to
+    );
+    if(last_year_month) {
+        write_month_runs(*last_year_month);
+    }
+
+    spdlog::info("Writing partial aggregate {}", path.string());
+    auto temporary_path = std::filesystem::path(path).concat(".tmp");
+    partial_aggregate_writer writer(
+        temporary_path,
+        options.case_folded,
+        from.value_or(sys_ms::min()),
+        to.value_or(sys_ms::max())
+    );
+    for(const auto* set : count_sets()) {
+        indexinator<ngram_max_width>([&] <auto I> {
+            std::vector<std::unique_ptr<month_run_reader<I + 1>>> runs;
+            std::vector<month_run_reader<I + 1>*> readers;
+            for(auto month : months) {
+                runs.push_back(std::make_unique<month_run_reader<I + 1>>(run_path(*set, I + 1, month), month));
+                readers.push_back(runs.back().get());
+            }
+            writer.begin_section();
+            std::vector<month_count> counts;
+            merge_sorted<month_run_reader<I + 1>>(
+                readers,
+                [&](const ngram_view<I + 1>& key, std::span<month_run_reader<I + 1>* const> matching) {
+                    std::uint64_t total = 0;
+                    counts.clear();
+                    for(const auto* run : matching) {
+                        total += run->count();
+                        counts.push_back({run->month(), run->count()});
+                    }
+                    std::ranges::sort(counts, {}, &month_count::month);
+                    writer.write_record(key, total, counts);
+                }
+            );
+        });
+    }
+    writer.close();
+    std::filesystem::rename(temporary_path, path);
+    std::filesystem::remove_all(runs_directory);
+    spdlog::info("Finished");
+}
+
+// The result is what run() over the union of the ranges would write: survivors come out of the merge in sorted order,
+// which is id order, and each survivor's noise is drawn once per month it appears in, in month order, like do_flush.
+// The merge is ngram-major, the frequencies are staged and then written month-major like do_flush writes them.
+void Aggregator::merge_partials(std::span<const std::filesystem::path> paths) {
+    if(paths.empty()) {
+        throw std::runtime_error("Nothing to merge");
+    }
+    if(options.granularity != bucket_granularity::month || options.prune_interval != 0) {
+        throw std::runtime_error("Partial aggregates only support exact monthly counts");
+    }
+    std::vector<std::unique_ptr<partial_aggregate>> owned;
+    for(const auto& path : paths) {
+        owned.push_back(std::make_unique<partial_aggregate>(path));
+    }
+    std::ranges::sort(owned, {}, [](const auto& partial) { return partial->from(); });
+    std::vector<const partial_aggregate*> partials;
+    for(std::size_t i = 0; i < owned.size(); i++) {
+        if(owned[i]->case_folded() != owned.front()->case_folded()) {
+            throw std::runtime_error("Partial aggregates were written with different --case-folded settings");
+        }
+        if(i != 0 && owned[i]->from() < owned[i - 1]->to()) {
+            throw std::runtime_error(
+                fmt::format(
+                    "Partial aggregates overlap: {} to {} and {} to {}",
+                    range_bound(owned[i - 1]->from()),
+                    range_bound(owned[i - 1]->to()),
+                    range_bound(owned[i]->from()),
+                    range_bound(owned[i]->to())
+                )
+            );
+        }
+        if(i != 0 && owned[i]->from() > owned[i - 1]->to()) {
+            spdlog::warn(
+                "No partial aggregate covers {} to {}",
+                range_bound(owned[i - 1]->to()),
+                range_bound(owned[i]->from())
+            );
+        }
+        partials.push_back(owned[i].get());
+    }
+    options.case_folded = owned.front()->case_folded();
+
+    spdlog::info("Preparing db");
+    setup_database(std::nullopt);
+    for(std::size_t set_index = 0; set_index < count_sets().size(); set_index++) {
+        auto& set = *count_sets()[set_index];
+        spdlog::info("Merging {} partial aggregates{}", partials.size(), set.suffix);
+        // month totals are the surviving unigrams' counts, as count_message counts them
+        ankerl::unordered_dense::map<std::int32_t, std::uint64_t> month_totals;
+        merge_partial_aggregates<1>(
+            partials,
+            set_index,
+            [&](const ngram_view<1>&, std::uint64_t total, std::span<const month_count> months) {
+                if(total >= minimum_occurrences) {
+                    for(const auto& [month, count] : months) {
+                        month_totals[month] += count;
+                    }
+                }
+            }
+        );
+        do_query(
+            fmt::format(
+                "CREATE TEMPORARY TABLE frequencies_staging{} (months_since_epoch INTEGER, ngram_id INTEGER,"
+                " frequency REAL)",
+                set.suffix
+            )
+        );
+        duckdb::Appender appender(*con, fmt::format("frequencies_staging{}", set.suffix));
+        std::uint32_t id = 0;
+        indexinator<ngram_max_width>([&] <auto I> {
+            std::vector<typename augmented_counts_map<I + 1>::value_type> entries;
+            merge_partial_aggregates<I + 1>(
+                partials,
+                set_index,
+                [&](const ngram_view<I + 1>& key, std::uint64_t total, std::span<const month_count> months) {
+                    if(total < minimum_occurrences) {
+                        return;
+                    }
+                    auto noise_source = make_xoroshiro128plus(sha256(key, nonce));
+                    for(const auto& [month, count] : months) {
+                        double frequency = count / double(month_totals.at(month));
+                        frequency += frequency * 0.01 * random_double(noise_source());
+                        appender.AppendRow(month, int64_t(id), frequency);
+                    }
+                    entries.emplace_back(key, augmented_entry{id++, 0, std::uint32_t(total), 0, noise_source});
+                }
+            );
+            spdlog::info("Surviving {}-grams{}: {}", I + 1, set.suffix, entries.size());
+            std::get<I>(set.counts) = augmented_counts_map<I + 1>(std::move(entries));
+        });
+        appender.Close();
+        do_query(
+            fmt::format(
+                "INSERT INTO frequencies{0} SELECT * FROM frequencies_staging{0} ORDER BY months_since_epoch, ngram_id",
+                set.suffix
+            )
+        );
+        do_query(fmt::format("DROP TABLE frequencies_staging{}", set.suffix));
+        spdlog::info("Populating ngram tables{}", set.suffix);
+        populate_ngram_tables(set);
+        create_gram_indexes(set);
+        create_completions(set);
+    }
+    publish_database();
+    spdlog::info("Finished");
+}
+
+// Invokes the callback with each count set and the message content as that set sees it
+template<typename C>
+void Aggregator::for_each_message_set(std::string_view content, const C& callback) {
+    callback(exact, content);
+    if(options.case_folded) {
+        folded_content.clear();
+        fold_case(content, folded_content);
+        callback(folded, std::string_view(folded_content));
+    }
+}
+
+void Aggregator::preprocess(std::optional<sys_ms> resume_from) {
+    // The preprocessed_counts map here is absolutely massive, many GiB's. --prune-interval trims it periodically at the
+    // cost of exactness, --spill-budget keeps it exact by spilling to disk.
+    // Spilled runs would each carry their own insertion errors for an ngram and merging them would add those up
+    bool spills = options.spill_budget != 0
+        || (options.memory_budget != 0 && options.over_budget == budget_action::spill);
+    if(options.prune_interval != 0 && spills) {
+        throw std::runtime_error("Lossy counting can't be combined with spilling first-pass counts to disk");
+    }
+    std::optional<std::chrono::year_month> last_year_month;
+    std::uint64_t bucket_messages = 0;
+    std::chrono::year_month last_checkpoint = agg_epoch;
+    auto reader = db->make_reader(resume_from);
+    process_messages(*reader, [&](sys_ms timestamp, std::string_view content) {
         if(blacklisted_timestamp(timestamp)) {
             return;
         }
-        tokenize(content, [&](const ngram_window& ngram) {
-            indexinator<ngram_max_width>([&] <auto I> {
-                if(auto value = ngram.subview<I + 1>()) {
-                    std::get<I>(preprocessed_counts)[*value]++;
+        auto year_month = to_year_month(timestamp);
+        if(!last_year_month) {
+            last_checkpoint = year_month;
+        } else if(year_month != *last_year_month) {
+            if(should_checkpoint(year_month, last_checkpoint)) {
+                write_checkpoint(phase::preprocess, year_month);
+            }
+        }
+        last_year_month = year_month;
+        if(options.prune_interval != 0 && ++bucket_messages == options.prune_interval) {
+            prune_counts();
+            bucket_messages = 0;
+        }
+        for_each_message_set(content, [&](count_set& set, std::string_view content) {
+            tokenize(content, [&](const ngram_window& ngram) {
+                indexinator<ngram_max_width>([&] <auto I> {
+                    if(auto value = ngram.subview<I + 1>()) {
+                        bool inserted;
+                        if(options.prune_interval != 0) {
+                            inserted = add_lossy_count(std::get<I>(set.lossy_counts), *value, prune_rounds);
+                        } else {
+                            auto [it, new_entry] = std::get<I>(set.preprocessed_counts).try_emplace(*value, 0);
+                            it->second++;
+                            inserted = new_entry;
+                        }
+                        if(inserted && (options.spill_budget != 0 || options.memory_budget != 0)) {
+                            enforce_budgets<I>();
+                        }
+                    }
+                });
+            });
+        });
+    });
+    merge_spilled_runs();
+    spdlog::info("First pass memory: {}", memory_report());
+    if(options.prune_interval != 0) {
+        report_pruning();
+        finish_lossy_counts();
+        if(options.verify_pruned) {
+            verify_pruned_counts();
+        }
+    }
+    for(const auto* set : count_sets()) {
+        indexinator<ngram_max_width>([&] <auto I> {
+            spdlog::info(
+                "Preprocessed counts for {}-grams{}: {}",
+                I + 1,
+                set->suffix,
+                std::get<I>(set->preprocessed_counts).size()
+            );
+        });
+    }
+}
+
+// Called after each new first-pass entry of width I + 1, only that width can have grown past its own budget
+template<std::size_t I>
+void Aggregator::enforce_budgets() {
+    constexpr std::size_t mib = 1024 * 1024;
+    if(options.spill_budget != 0 && ngram_memory<I + 1>::bytes() > options.spill_budget * mib) {
+        spill<I>();
+    }
+    if(options.memory_budget == 0) {
+        return;
+    }
+    std::size_t total = 0;
+    std::size_t largest_width = 0;
+    std::size_t largest = 0;
+    indexinator<ngram_max_width>([&] <auto J> {
+        auto bytes = ngram_memory<J + 1>::bytes();
+        total += bytes;
+        if(bytes > largest) {
+            largest = bytes;
+            largest_width = J;
+        }
+    });
+    if(total <= options.memory_budget * mib) {
+        return;
+    }
+    if(options.over_budget == budget_action::abort) {
+        throw std::runtime_error(
+            fmt::format("First pass exceeded its memory budget of {} MiB: {}", options.memory_budget, memory_report())
+        );
+    }
+    spdlog::info("Over the memory budget, spilling {}-grams: {}", largest_width + 1, memory_report());
+    indexinator<ngram_max_width>([&] <auto J> {
+        if(J == largest_width) {
+            spill<J>();
+        }
+    });
+}
+
+// Each bucket of --prune-interval messages ends with an eviction, see lossy_counts.hpp. The evicted entries' keys
+// are dropped from the overflow arenas along the way.
+void Aggregator::prune_counts() {
+    prune_rounds++;
+    auto sets = count_sets();
+    std::array<std::size_t, 2> evicted{};
+    indexinator<ngram_max_width>([&] <auto I> {
+        monotonic_arena compacted;
+        for(std::size_t i = 0; i < sets.size(); i++) {
+            evicted[i] += prune_lossy_counts(std::get<I>(sets[i]->lossy_counts), prune_rounds, compacted);
+        }
+        packed_ngram<I + 1>::arena().swap(compacted);
+    });
+    for(std::size_t i = 0; i < sets.size(); i++) {
+        spdlog::info("Pruned {} ngrams{} at the end of bucket {}", evicted[i], sets[i]->suffix, prune_rounds);
+    }
+}
+
+void Aggregator::report_pruning() {
+    for(const auto* set : count_sets()) {
+        std::size_t kept = 0;
+        std::size_t uncertain = 0;
+        indexinator<ngram_max_width>([&] <auto I> {
+            for(const auto& [key, value] : std::get<I>(set->lossy_counts)) {
+                kept += value.count >= minimum_occurrences;
+                uncertain += value.count < minimum_occurrences && value.count + value.error >= minimum_occurrences;
+            }
+        });
+        spdlog::info(
+            "Lossy counting{}: {} ngrams reached the threshold, {} more might have{}",
+            set->suffix,
+            kept,
+            uncertain,
+            options.verify_pruned ? " and will be recounted" : ""
+        );
+    }
+}
+
+// Moves the lossy counts to preprocessed_counts. Unverified only counts, which never overstate, that reach the
+// threshold are kept. Verified everything that could reach it is kept at 0 for verify_pruned_counts to recount.
+void Aggregator::finish_lossy_counts() {
+    indexinator<ngram_max_width>([&] <auto I> {
+        monotonic_arena compacted;
+        for(auto* set : count_sets()) {
+            auto& lossy = std::get<I>(set->lossy_counts);
+            auto& counts = std::get<I>(set->preprocessed_counts);
+            auto values = counts.extract();
+            for(const auto& [key, value] : lossy) {
+                auto bound = options.verify_pruned ? value.count + value.error : value.count;
+                if(bound >= minimum_occurrences) {
+                    values.emplace_back(key, options.verify_pruned ? 0 : value.count);
+                    values.back().first.relocate(compacted);
                 }
+            }
+            lossy = lossy_counts_map<I + 1>();
+            counts.replace(std::move(values));
+        }
+        packed_ngram<I + 1>::arena().swap(compacted);
+    });
+}
+
+// Recounts the candidates exactly, setup_ngram_maps filters on the exact counts
+void Aggregator::verify_pruned_counts() {
+    spdlog::info("Verifying pruned counts");
+    auto reader = db->make_reader(std::nullopt);
+    process_messages(*reader, [&](sys_ms timestamp, std::string_view content) {
+        if(blacklisted_timestamp(timestamp)) {
+            return;
+        }
+        for_each_message_set(content, [&](count_set& set, std::string_view content) {
+            tokenize(content, [&](const ngram_window& ngram) {
+                indexinator<ngram_max_width>([&] <auto I> {
+                    if(auto value = ngram.subview<I + 1>()) {
+                        auto& map = std::get<I>(set.preprocessed_counts);
+                        if(auto it = map.find(*value); it != map.end()) {
+                            it->second++;
+                        }
+                    }
+                });
             });
         });
     });
+}
+
+std::string Aggregator::memory_report() {
+    constexpr double mib = 1024 * 1024;
+    std::string report;
     indexinator<ngram_max_width>([&] <auto I> {
-        spdlog::info("Preprocessed counts for {}-grams: {}", I + 1, std::get<I>(preprocessed_counts).size());
+        fmt::format_to(
+            std::back_inserter(report),
+            "{}{}-grams {:.1f} MiB (maps peaked at {:.1f} MiB)",
+            I == 0 ? "" : ", ",
+            I + 1,
+            double(ngram_memory<I + 1>::bytes()) / mib,
+            double(ngram_memory<I + 1>::account().peak()) / mib
+        );
     });
+    return report;
+}
+
+// Spills every set's counts of a width, they share the width's overflow arena
+template<std::size_t I>
+void Aggregator::spill() {
+    std::filesystem::create_directories(spill_directory);
+    for(auto* set : count_sets()) {
+        auto& map = std::get<I>(set->preprocessed_counts);
+        if(map.empty()) {
+            continue;
+        }
+        auto path = spill_run_path(*set, I + 1, set->spill_runs[I]++);
+        spdlog::info("Spilling {} {}-grams to {}", map.size(), I + 1, path.string());
+        write_run<I + 1>(path, map);
+        // clear() would keep the capacity, which still counts against the budgets
+        map = counts_map<I + 1>();
+    }
+    // nothing else holds keys of this width during the first pass
+    packed_ngram<I + 1>::arena().reset();
 }
 
-void Aggregator::setup_ngram_maps() {
+void Aggregator::merge_spilled_runs() {
+    indexinator<ngram_max_width>([&] <auto I> {
+        auto sets = count_sets();
+        if(std::ranges::none_of(sets, [](const count_set* set) { return set->spill_runs[I] != 0; })) {
+            return;
+        }
+        // whatever is still in memory becomes one more run, after this everything of this width is on disk
+        spill<I>();
+        for(auto* set : sets) {
+            if(set->spill_runs[I] == 0) {
+                continue;
+            }
+            auto& map = std::get<I>(set->preprocessed_counts);
+            std::vector<std::filesystem::path> runs;
+            for(std::size_t i = 0; i < set->spill_runs[I]; i++) {
+                runs.push_back(spill_run_path(*set, I + 1, i));
+            }
+            spdlog::info("Merging {} runs of {}-grams{}", runs.size(), I + 1, set->suffix);
+            // only ngrams that can survive setup_ngram_maps need to come back into memory
+            merge_runs<I + 1>(runs, [&](const ngram_view<I + 1>& key, std::uint64_t total) {
+                if(total >= minimum_occurrences) {
+                    map.try_emplace(key, std::uint32_t(total));
+                }
+            });
+            for(const auto& run : runs) {
+                std::filesystem::remove(run);
+            }
+            set->spill_runs[I] = 0;
+        }
+    });
+}
+
+std::filesystem::path Aggregator::spill_run_path(const count_set& set, std::size_t width, std::size_t run) {
+    return spill_directory / fmt::format("{}-grams{}.{}.run", width, set.suffix, run);
+}
+
+void Aggregator::setup_ngram_maps(count_set& set) {
+    // Filtering and seeding (a sha256 per survivor) is done in parallel over chunks of each first-pass map. Inserting
+    // into the new maps and freeing the first-pass maps is done with a thread per width, overlapping with the next
+    // width's filtering. Ids are assigned in sorted ngram order within each width, each width's ids following the
+    // previous width's, so they only depend on which ngrams survive.
+    constexpr std::size_t chunk_size = 1 << 16;
     std::uint32_t id = 0;
+    std::vector<std::jthread> inserters;
     indexinator<ngram_max_width>([&] <auto I> {
-        for(const auto& [k, v] : std::get<I>(preprocessed_counts)) {
-            if(v >= minimum_occurrences) {
-                // this is overkill
-                std::get<I>(counts).emplace(k, augmented_entry{id++, 0, make_xoroshiro128plus(sha256(k, nonce))});
-                spdlog::debug("{}\t{}", k, v);
+        using survivor = std::pair<packed_ngram<I + 1>, augmented_entry>;
+        const auto& entries = std::get<I>(set.preprocessed_counts).values();
+        auto chunks = (entries.size() + chunk_size - 1) / chunk_size;
+        std::vector<std::vector<survivor>> survivors(chunks);
+        parallel_for(chunks, [&](std::size_t chunk) {
+            auto begin = entries.begin() + chunk * chunk_size;
+            auto end = entries.begin() + std::min(entries.size(), (chunk + 1) * chunk_size);
+            for(const auto& [k, v] : std::ranges::subrange(begin, end)) {
+                if(v >= minimum_occurrences) {
+                    // this is overkill
+                    survivors[chunk].emplace_back(
+                        k,
+                        augmented_entry{0, 0, v, 0, make_xoroshiro128plus(sha256(k, nonce))}
+                    );
+                    spdlog::debug("{}\t{}", k, v);
+                }
             }
+        });
+        std::size_t total_survivors = 0;
+        for(const auto& chunk : survivors) {
+            total_survivors += chunk.size();
         }
+        spdlog::info("Surviving {}-grams{}: {}", I + 1, set.suffix, total_survivors);
+        inserters.emplace_back([this, &set, survivors = std::move(survivors), total_survivors, base = id] () mutable {
+            std::vector<survivor> entries;
+            entries.reserve(total_survivors);
+            for(auto& chunk : survivors) {
+                std::ranges::move(chunk, std::back_inserter(entries));
+                chunk = {};
+            }
+            std::ranges::sort(entries, [](const survivor& a, const survivor& b) {
+                return ngram_less(a.first, b.first);
+            });
+            auto id = base;
+            for(auto& [k, entry] : entries) {
+                entry.id = id++;
+            }
+            std::get<I>(set.counts) = augmented_counts_map<I + 1>(std::move(entries));
+            build_filter<I>(set);
+            // totals now live in the surviving entries, the first-pass map is no longer needed
+            auto& preprocessed = std::get<I>(set.preprocessed_counts);
+            preprocessed = std::remove_cvref_t<decltype(preprocessed)>();
+        });
+        id += std::uint32_t(total_survivors);
     });
 }
 
-void Aggregator::setup_database() {
-    if(std::filesystem::exists("ngrams.duckdb")) {
-        std::filesystem::remove("ngrams.duckdb");
+void Aggregator::setup_database(std::optional<std::chrono::year_month> resume_month) {
+    if(resume_month) {
+        aggdb.emplace(staging_database_path.string());
+        con.emplace(*aggdb);
+        // anything flushed after the checkpoint was taken is redone
+        for(const auto* set : count_sets()) {
+            do_query(
+                fmt::format(
+                    "DELETE FROM frequencies{} WHERE months_since_epoch >= {}",
+                    set->suffix,
+                    (*resume_month - agg_epoch).count()
+                )
+            );
+            if(options.granularity != bucket_granularity::month) {
+                for(auto table : {"series_staging"sv, "bucket_totals"sv}) {
+                    do_query(
+                        fmt::format(
+                            "DELETE FROM {}{} WHERE months_since_epoch >= {}",
+                            table,
+                            set->suffix,
+                            (*resume_month - agg_epoch).count()
+                        )
+                    );
+                }
+            }
+        }
+        return;
     }
-    aggdb.emplace("ngrams.duckdb");
+    std::filesystem::remove(staging_database_path);
+    std::filesystem::remove(std::filesystem::path(staging_database_path).concat(".wal"));
+    aggdb.emplace(staging_database_path.string());
     con.emplace(*aggdb);
-    do_query("CREATE TABLE frequencies (months_since_epoch INTEGER, ngram_id INTEGER, frequency REAL)");
-    indexinator<ngram_max_width>([&] <auto I> {
-        auto text_columns = std::ranges::iota_view{std::size_t(0), I + 1} | std::views::transform([](auto i) {
-            return fmt::format("gram_{}", i);
-        });
+    // lets the server know how this database was built
+    do_query("CREATE TABLE metadata (key TEXT PRIMARY KEY, value TEXT)");
+    do_query(fmt::format("INSERT INTO metadata VALUES ('max_width', '{}')", ngram_max_width));
+    do_query(fmt::format("INSERT INTO metadata VALUES ('case_folded', '{}')", options.case_folded));
+    do_query(fmt::format("INSERT INTO metadata VALUES ('completion_prefix_limit', '{}')", completion_prefix_limit));
+    constexpr std::array granularity_names = {"month", "week", "day"};
+    do_query(
+        fmt::format(
+            "INSERT INTO metadata VALUES ('granularity', '{}')",
+            granularity_names[std::size_t(options.granularity)]
+        )
+    );
+    for(const auto* set : count_sets()) {
         do_query(
             fmt::format(
-                "CREATE TABLE ngrams_{} (ngram_id INTEGER PRIMARY KEY, {}, total INTEGER)",
-                I + 1,
-                fmt::join(
-                    text_columns | std::views::transform([](auto&& name){ return fmt::format("{} TEXT", name); }),
-                    ", "
-                )
+                "CREATE TABLE frequencies{} (months_since_epoch INTEGER, ngram_id INTEGER, frequency REAL)",
+                set->suffix
             )
         );
-    });
+        if(options.granularity != bucket_granularity::month) {
+            // Sub-month buckets are staged as noised counts, a bucket can be flushed in parts when it straddles a
+            // month boundary. months_since_epoch is the month the part was flushed in, for resuming.
+            do_query(
+                fmt::format(
+                    "CREATE TABLE series_staging{} (months_since_epoch INTEGER, bucket INTEGER, ngram_id INTEGER,"
+                    " noised_count REAL)",
+                    set->suffix
+                )
+            );
+            do_query(
+                fmt::format(
+                    "CREATE TABLE bucket_totals{} (months_since_epoch INTEGER, bucket INTEGER, total BIGINT)",
+                    set->suffix
+                )
+            );
+        }
+        indexinator<ngram_max_width>([&] <auto I> {
+            auto text_columns = std::ranges::iota_view{std::size_t(0), I + 1} | std::views::transform([](auto i) {
+                return fmt::format("gram_{}", i);
+            });
+            do_query(
+                fmt::format(
+                    "CREATE TABLE ngrams{}_{} (ngram_id INTEGER PRIMARY KEY, {}, total INTEGER, rank INTEGER)",
+                    set->suffix,
+                    I + 1,
+                    fmt::join(
+                        text_columns | std::views::transform([](auto&& name){ return fmt::format("{} TEXT", name); }),
+                        ", "
+                    )
+                )
+            );
+        });
+    }
 }
 
-void Aggregator::populate_ngram_tables() {
+void Aggregator::populate_ngram_tables(count_set& set) {
+    // Rows are written in rank order (total descending) so that the server's top-k queries only have to look at the
+    // first few row groups: ORDER BY rank LIMIT k can skip everything past the current k-th rank by zone maps. Ties
+    // are broken by id, so ranks are as stable as ids are.
     indexinator<ngram_max_width>([&] <auto I> {
-        duckdb::Appender appender(*con, fmt::format("ngrams_{}", I + 1));
-        for(const auto& [ngram, entry] : std::get<I>(counts)) {
+        using value_type = typename std::tuple_element_t<I, AugmentedCounts>::value_type;
+        std::vector<const value_type*> ranked;
+        ranked.reserve(std::get<I>(set.counts).size());
+        for(const auto& entry : std::get<I>(set.counts)) {
+            ranked.push_back(&entry);
+        }
+        std::ranges::sort(ranked, [](const value_type* a, const value_type* b) {
+            return std::tie(b->second.total, a->second.id) < std::tie(a->second.total, b->second.id);
+        });
+        duckdb::Appender appender(*con, fmt::format("ngrams{}_{}", set.suffix, I + 1));
+        for(std::size_t rank = 0; rank < ranked.size(); rank++) {
+            const auto& [ngram, entry] = *ranked[rank];
             [&]<std::size_t... NI>(std::index_sequence<NI...>) {
                 appender.AppendRow(
                     int64_t(entry.id),
-                    (duckdb::Value(ngram[NI]))...,
-                    int64_t(std::get<I>(preprocessed_counts).at(ngram))
+                    (duckdb::Value(std::string(ngram[NI])))...,
+                    int64_t(entry.total),
+                    int64_t(rank)
                 );
             }(std::make_index_sequence<I + 1>{});
         }
     });
 }
 
-void Aggregator::do_flush(std::chrono::year_month date, std::uint64_t total_for_month) {
-    duckdb::Appender appender(*con, "frequencies");
+void Aggregator::create_gram_indexes(const count_set& set) {
+    // Auxiliary tables for the server's query planner, letting GLOB patterns on a gram position be narrowed down to
+    // candidate grams instead of scanning every row of ngrams_N. Every gram of a surviving ngram is itself a surviving
+    // unigram so indexing ngrams_1 covers every position of every table. Both are built by duckdb so that lower() and
+    // reverse() agree with what the server uses at query time.
+    // Reversed grams, for suffix patterns like *_ptr
+    do_query(
+        fmt::format(
+            "CREATE TABLE gram_suffixes{0} AS"
+            " SELECT reverse(gram_0) AS gram_reversed, reverse(lower(gram_0)) AS gram_reversed_lower, gram_0 AS gram"
+            " FROM ngrams{0}_1"
+            " ORDER BY gram_reversed",
+            set.suffix
+        )
+    );
+    // Trigram posting lists over lowercased grams, for infix patterns like *alloc*
+    do_query(
+        fmt::format(
+            "CREATE TABLE gram_trigrams{0} AS"
+            " SELECT DISTINCT substring(lower(gram), i, 3) AS trigram, gram"
+            " FROM (SELECT gram_0 AS gram, unnest(range(1, length(lower(gram_0)) - 1)) AS i FROM ngrams{0}_1)"
+            " ORDER BY trigram",
+            set.suffix
+        )
+    );
+}
+
+void Aggregator::create_completions(const count_set& set) {
+    // Prefix -> top completions for the server's autocomplete, which keeps the whole table in memory. Each width's
+    // ngrams are joined with spaces and lowercased, every prefix gets its highest ranked completions. A prefix with at
+    // most completions_per_prefix matches already lists all of them and longer prefixes are left for the server to
+    // filter out of it, so only prefixes whose parent has more matches than fit are stored.
+    do_query(
+        fmt::format(
+            "CREATE TABLE completions{} (width INTEGER, prefix TEXT, complete BOOLEAN, completions TEXT[])",
+            set.suffix
+        )
+    );
     indexinator<ngram_max_width>([&] <auto I> {
-        for(auto& [k, entry] : std::get<I>(counts)) {
+        auto grams = std::ranges::iota_view{std::size_t(0), I + 1} | std::views::transform([](auto i) {
+            return fmt::format("gram_{}", i);
+        });
+        do_query(
+            fmt::format(
+                "INSERT INTO completions{0}"
+                " WITH prefixes AS ("
+                "  SELECT left(phrase, i) AS prefix, text, rank"
+                "  FROM ("
+                "   SELECT phrase, text, rank, unnest(range(1, least(length(phrase), {2}) + 1)) AS i"
+                "   FROM (SELECT lower(text) AS phrase, text, rank"
+                "    FROM (SELECT concat_ws(' ', {4}) AS text, rank FROM ngrams{0}_{1}))"
+                "  )"
+                " ), ranked AS ("
+                "  SELECT prefix, text, row_number() OVER (PARTITION BY prefix ORDER BY rank) AS position,"
+                "   count(*) OVER (PARTITION BY prefix) AS matches"
+                "  FROM prefixes"
+                " ), nodes AS ("
+                "  SELECT prefix, any_value(matches) AS matches, list(text ORDER BY position) AS completions"
+                "  FROM ranked WHERE position <= {3} GROUP BY prefix"
+                " )"
+                " SELECT {1}, node.prefix, node.matches <= {3}, node.completions"
+                " FROM nodes AS node"
+                " LEFT JOIN nodes AS parent ON parent.prefix = left(node.prefix, length(node.prefix) - 1)"
+                " WHERE length(node.prefix) = 1 OR parent.matches > {3}"
+                " ORDER BY node.prefix",
+                set.suffix,
+                I + 1,
+                completion_prefix_limit,
+                completions_per_prefix,
+                fmt::join(grams, ", ")
+            )
+        );
+    });
+}
+
+void Aggregator::do_flush(count_set& set, std::chrono::year_month date) {
+    // rows are written in id order, each month's rows are sorted by ngram_id
+    duckdb::Appender appender(*con, fmt::format("frequencies{}", set.suffix));
+    indexinator<ngram_max_width>([&] <auto I> {
+        std::get<I>(set.counts).for_each_in_order([&](auto& value) {
+            auto& entry = value.second;
             if(entry.count == 0) {
-                continue;
+                return;
             }
             auto months_since_epoch = date - agg_epoch;
-            double frequency = entry.count / double(total_for_month);
+            double frequency = entry.count / double(set.total_for_month);
             frequency += frequency * 0.01 * random_double(entry.noise_source());
             appender.AppendRow(
                 months_since_epoch.count(),
@@ -149,42 +877,367 @@ void Aggregator::do_flush(std::chrono::year_month date, std::uint64_t total_for_
                 frequency
             );
             entry.count = 0;
+        });
+    });
+    set.total_for_month = 0;
+}
+
+std::int32_t Aggregator::bucket_of(sys_ms timestamp) const {
+    auto days = (std::chrono::floor<std::chrono::days>(timestamp) - bucket_epoch).count();
+    return std::int32_t(options.granularity == bucket_granularity::week ? days / 7 : days);
+}
+
+void Aggregator::flush_bucket(count_set& set, std::int32_t bucket, std::chrono::year_month date) {
+    duckdb::Appender appender(*con, fmt::format("series_staging{}", set.suffix));
+    auto months_since_epoch = (date - agg_epoch).count();
+    indexinator<ngram_max_width>([&] <auto I> {
+        std::get<I>(set.counts).for_each_in_order([&](auto& value) {
+            auto& entry = value.second;
+            if(entry.bucket_count == 0) {
+                return;
+            }
+            double count = entry.bucket_count;
+            count += count * 0.01 * random_double(entry.noise_source());
+            appender.AppendRow(months_since_epoch, bucket, int64_t(entry.id), float(count));
+            entry.bucket_count = 0;
+        });
+    });
+    appender.Close();
+    duckdb::Appender totals(*con, fmt::format("bucket_totals{}", set.suffix));
+    totals.AppendRow(months_since_epoch, bucket, int64_t(set.total_for_bucket));
+    set.total_for_bucket = 0;
+}
+
+// The message's lookups are collected and resolved together so that their cache misses overlap, counting is order
+// independent
+void Aggregator::count_message(count_set& set, std::string_view content, bool bucketed) {
+    auto count = [&](augmented_entry& entry, bool unigram) {
+        entry.count++;
+        entry.bucket_count += bucketed;
+        if(unigram) {
+            set.total_for_month++;
+            set.total_for_bucket += bucketed;
         }
+    };
+    // repeats of short messages replay the entries they resolved to last time
+    std::vector<count_set::cached_hit>* cached = nullptr;
+    if(set.cache.eligible(content)) {
+        auto hash = set.cache.hash(content);
+        if(const auto* hits = set.cache.find(content, hash)) {
+            for(const auto& [entry, unigram] : *hits) {
+                count(*entry, unigram);
+            }
+            return;
+        }
+        cached = &set.cache.insert(content, hash);
+    }
+    indexinator<ngram_max_width>([&] <auto I> {
+        std::get<I>(probes).clear();
+    });
+    tokenize(content, [&](const ngram_window& ngram) {
+        indexinator<ngram_max_width>([&] <auto I> {
+            if(auto value = ngram.subview<I + 1>()) {
+                std::get<I>(probes).push_back({*value, ngram_hash{}(*value)});
+            }
+        });
+    });
+    indexinator<ngram_max_width>([&] <auto I> {
+        batched_lookup(
+            std::get<I>(set.counts),
+            set.filters[I],
+            std::get<I>(probes),
+            set.filter_stats[I],
+            [&](augmented_entry& entry) {
+                count(entry, I == 0);
+                if(cached) {
+                    cached->push_back({&entry, I == 0});
+                }
+            }
+        );
     });
 }
 
-void Aggregator::do_aggregation() {
-    std::uint64_t total_for_month = 0;
+void Aggregator::do_aggregation(std::optional<sys_ms> resume_from) {
+    const bool bucketed = options.granularity != bucket_granularity::month;
     std::optional<std::chrono::year_month> last_year_month;
-    auto reader = db.make_message_database_reader();
-    process_messages(reader, [&](sys_ms timestamp, std::string_view content) {
+    std::int32_t last_bucket = 0;
+    std::chrono::year_month last_checkpoint = agg_epoch;
+    for(auto* set : count_sets()) {
+        set->cache = message_cache<count_set::cached_hit>(options.message_cache_size);
+    }
+    auto reader = db->make_reader(resume_from);
+    process_messages(*reader, [&](sys_ms timestamp, std::string_view content) {
         if(blacklisted_timestamp(timestamp)) {
             return;
         }
-        auto date = std::chrono::year_month_day(std::chrono::floor<std::chrono::days>(timestamp));
-        auto year_month = std::chrono::year_month(date.year(), date.month());
+        auto year_month = to_year_month(timestamp);
+        auto bucket = bucketed ? bucket_of(timestamp) : 0;
         if(!last_year_month) {
             last_year_month = year_month;
-        } else if(year_month != *last_year_month) {
+            last_bucket = bucket;
+            last_checkpoint = year_month;
+        } else if(bucketed && (year_month != *last_year_month || bucket != last_bucket)) {
+            // buckets are also flushed at month boundaries so that everything before a checkpoint is on disk
+            for(auto* set : count_sets()) {
+                flush_bucket(*set, last_bucket, *last_year_month);
+            }
+            last_bucket = bucket;
+        }
+        if(year_month != *last_year_month) {
             spdlog::info("Flush {}", timestamp);
-            do_flush(*last_year_month, total_for_month);
-            total_for_month = 0;
+            for(auto* set : count_sets()) {
+                do_flush(*set, *last_year_month);
+            }
             last_year_month = year_month;
+            if(should_checkpoint(year_month, last_checkpoint)) {
+                write_checkpoint(phase::aggregation, year_month);
+            }
         }
-        tokenize(content, [&](const ngram_window& ngram) {
-            indexinator<ngram_max_width>([&] <auto I> {
-                if(auto value = ngram.subview<I + 1>()) {
-                    auto& the_counts = std::get<I>(counts);
-                    if(auto it = the_counts.find(*value); it != the_counts.end()) {
-                        it->second.count++;
-                        if(I == 0) {
-                            total_for_month++;
-                        }
-                    }
-                }
-            });
+        for_each_message_set(content, [&](count_set& set, std::string_view content) {
+            count_message(set, content, bucketed);
         });
     });
+    // the last month has no boundary after it
+    if(last_year_month) {
+        spdlog::info("Flush {}", month_start(*last_year_month));
+        for(auto* set : count_sets()) {
+            if(bucketed) {
+                flush_bucket(*set, last_bucket, *last_year_month);
+            }
+            do_flush(*set, *last_year_month);
+        }
+    }
+    for(const auto* set : count_sets()) {
+        log_filter_stats(*set);
+        auto lookups = set->cache.hits() + set->cache.misses();
+        spdlog::info(
+            "Message cache{}: {} hits of {} short messages ({:.1f}%)",
+            set->suffix,
+            set->cache.hits(),
+            lookups,
+            lookups == 0 ? 0.0 : 100.0 * double(set->cache.hits()) / double(lookups)
+        );
+    }
+}
+
+template<std::size_t I>
+void Aggregator::build_filter(count_set& set) {
+    const auto& map = std::get<I>(set.counts);
+    if(options.bloom_fpr == 0 || map.empty()) {
+        return;
+    }
+    auto& filter = set.filters[I];
+    filter = blocked_bloom_filter(map.size(), options.bloom_fpr);
+    for(const auto& [key, entry] : map) {
+        filter.insert(ngram_hash{}(key));
+    }
+    spdlog::info("Filter for {}-grams{}: {:.1f} MiB", I + 1, set.suffix, double(filter.bytes()) / (1024 * 1024));
+}
+
+void Aggregator::log_filter_stats(const count_set& set) {
+    for(std::size_t i = 0; i < ngram_max_width; i++) {
+        const auto& stats = set.filter_stats[i];
+        auto misses = stats.rejected + stats.false_positives;
+        spdlog::info(
+            "{}-grams{}: {} hits, {} misses, {:.1f}% of misses rejected without probing the map",
+            i + 1,
+            set.suffix,
+            stats.hits,
+            misses,
+            misses == 0 ? 0.0 : 100.0 * double(stats.rejected) / double(misses)
+        );
+    }
+}
+
+void Aggregator::build_series(const count_set& set) {
+    // Sparse series, one row per ngram with only the buckets it appears in. Buckets are delta encoded, each delta is
+    // from the previous bucket (the first from 0), which keeps the lists small and compressible.
+    do_query(
+        fmt::format(
+            "CREATE TABLE series{0} AS"
+            " SELECT ngram_id, list(delta ORDER BY bucket) AS bucket_deltas,"
+            " list(frequency ORDER BY bucket) AS frequencies"
+            " FROM ("
+            "  SELECT ngram_id, bucket, frequency,"
+            "   bucket - coalesce(lag(bucket) OVER (PARTITION BY ngram_id ORDER BY bucket), 0) AS delta"
+            "  FROM ("
+            "   SELECT staging.ngram_id, staging.bucket,"
+            "    CAST(SUM(staging.noised_count) / totals.total AS REAL) AS frequency"
+            "   FROM series_staging{0} AS staging"
+            "   INNER JOIN (SELECT bucket, SUM(total) AS total FROM bucket_totals{0} GROUP BY bucket) AS totals"
+            "    ON totals.bucket = staging.bucket"
+            "   GROUP BY staging.ngram_id, staging.bucket, totals.total"
+            "  )"
+            " )"
+            " GROUP BY ngram_id"
+            " ORDER BY ngram_id",
+            set.suffix
+        )
+    );
+    do_query(fmt::format("DROP TABLE series_staging{}", set.suffix));
+    do_query(fmt::format("DROP TABLE bucket_totals{}", set.suffix));
+}
+
+void Aggregator::publish_database() {
+    do_query("CHECKPOINT");
+    con.reset();
+    aggdb.reset();
+    std::uint64_t previous = 0;
+    if(std::ifstream marker(version_marker_path); marker) {
+        marker >> previous;
+    }
+    auto version = previous + 1;
+    auto database_path = [](std::uint64_t version) { return fmt::format("ngrams-{}.duckdb", version); };
+    std::filesystem::rename(staging_database_path, database_path(version));
+    auto temporary_path = std::filesystem::path(version_marker_path).concat(".tmp");
+    binary_writer writer(temporary_path);
+    auto contents = fmt::format("{}\n", version);
+    writer.write_bytes(contents.data(), contents.size());
+    writer.close();
+    std::filesystem::rename(temporary_path, version_marker_path);
+    spdlog::info("Published {}", database_path(version));
+    // The previous version may still be serving queries until the server has switched over. Anything older is
+    // unused, earlier publishes removed everything before that.
+    if(previous > 1) {
+        for(auto old = previous - 1; old > 0 && std::filesystem::remove(database_path(old)); old--) {}
+    }
+}
+
+void Aggregator::write_checkpoint(phase current_phase, std::chrono::year_month resume_month) {
+    if(current_phase == phase::preprocessed) {
+        spdlog::info("Writing checkpoint for finished preprocessing");
+    } else {
+        spdlog::info("Writing checkpoint, resuming from {}", month_start(resume_month));
+    }
+    if(current_phase == phase::aggregation) {
+        // make sure everything flushed so far is durable before the checkpoint claims it is
+        do_query("CHECKPOINT");
+    }
+    auto temporary_path = std::filesystem::path(checkpoint_path).concat(".tmp");
+    binary_writer writer(temporary_path);
+    writer.write(checkpoint_magic);
+    writer.write(checkpoint_version);
+    writer.write(std::uint32_t(ngram_max_width));
+    writer.write(current_phase);
+    writer.write(std::int32_t((resume_month - agg_epoch).count()));
+    writer.write(options.case_folded);
+    writer.write(options.granularity);
+    writer.write(options.prune_interval);
+    writer.write(prune_rounds);
+    for(const auto* set : count_sets()) {
+        for(auto runs : set->spill_runs) {
+            writer.write(std::uint64_t(runs));
+        }
+        indexinator<ngram_max_width>([&] <auto I> {
+            if(current_phase == phase::aggregation) {
+                // in id order, which load_checkpoint relies on to rebuild the maps in the same order
+                const auto& map = std::get<I>(set->counts);
+                writer.write(std::uint64_t(map.size()));
+                map.for_each_in_order([&](const auto& value) {
+                    const auto& [ngram, entry] = value;
+                    write_ngram(writer, ngram);
+                    writer.write(entry.id);
+                    writer.write(entry.noise_source.serialize());
+                });
+            } else if(current_phase == phase::preprocess && options.prune_interval != 0) {
+                const auto& map = std::get<I>(set->lossy_counts);
+                writer.write(std::uint64_t(map.size()));
+                for(const auto& [ngram, value] : map) {
+                    write_ngram(writer, ngram);
+                    writer.write(value.count);
+                    writer.write(value.error);
+                }
+            } else {
+                const auto& map = std::get<I>(set->preprocessed_counts);
+                writer.write(std::uint64_t(map.size()));
+                for(const auto& [ngram, count] : map) {
+                    write_ngram(writer, ngram);
+                    writer.write(count);
+                }
+            }
+        });
+    }
+    writer.close();
+    std::filesystem::rename(temporary_path, checkpoint_path);
+}
+
+std::optional<std::pair<Aggregator::phase, std::chrono::year_month>> Aggregator::load_checkpoint() {
+    if(!std::filesystem::exists(checkpoint_path)) {
+        spdlog::warn("No checkpoint found, starting from scratch");
+        return std::nullopt;
+    }
+    spdlog::info("Loading checkpoint");
+    mapped_file file(checkpoint_path);
+    binary_reader reader(file.contents());
+    if(
+        reader.read<std::uint64_t>() != checkpoint_magic
+        || reader.read<std::uint32_t>() != checkpoint_version
+        || reader.read<std::uint32_t>() != ngram_max_width
+    ) {
+        throw std::runtime_error("Checkpoint file is not compatible with this build");
+    }
+    auto checkpoint_phase = reader.read<phase>();
+    auto resume_month = agg_epoch + std::chrono::months(reader.read<std::int32_t>());
+    if(reader.read<bool>() != options.case_folded) {
+        throw std::runtime_error("Checkpoint was taken with a different --case-folded setting");
+    }
+    if(reader.read<bucket_granularity>() != options.granularity) {
+        throw std::runtime_error("Checkpoint was taken with a different --granularity setting");
+    }
+    if(reader.read<std::uint64_t>() != options.prune_interval) {
+        throw std::runtime_error("Checkpoint was taken with a different --prune-interval setting");
+    }
+    prune_rounds = reader.read<std::uint32_t>();
+    for(auto* set : count_sets()) {
+        for(std::size_t i = 0; i < ngram_max_width; i++) {
+            set->spill_runs[i] = reader.read<std::uint64_t>();
+            // runs spilled after the checkpoint was taken are stale
+            for(auto run = set->spill_runs[i]; std::filesystem::exists(spill_run_path(*set, i + 1, run)); run++) {
+                std::filesystem::remove(spill_run_path(*set, i + 1, run));
+            }
+        }
+        indexinator<ngram_max_width>([&] <auto I> {
+            auto size = reader.read<std::uint64_t>();
+            if(checkpoint_phase == phase::aggregation) {
+                std::vector<typename augmented_counts_map<I + 1>::value_type> entries;
+                entries.reserve(size);
+                for(std::uint64_t i = 0; i < size; i++) {
+                    auto key = read_ngram<I + 1>(reader);
+                    auto id = reader.read<std::uint32_t>();
+                    auto state = reader.read<XoshiroCpp::Xoroshiro128Plus::state_type>();
+                    entries.emplace_back(key, augmented_entry{id, 0, 0, 0, XoshiroCpp::Xoroshiro128Plus(state)});
+                }
+                std::get<I>(set->counts) = augmented_counts_map<I + 1>(std::move(entries));
+                build_filter<I>(*set);
+            } else if(checkpoint_phase == phase::preprocess && options.prune_interval != 0) {
+                auto& map = std::get<I>(set->lossy_counts);
+                map.reserve(size);
+                for(std::uint64_t i = 0; i < size; i++) {
+                    auto key = read_ngram<I + 1>(reader);
+                    auto count = reader.read<std::uint32_t>();
+                    map.try_emplace(key, lossy_count{count, reader.read<std::uint32_t>()});
+                }
+            } else {
+                auto& map = std::get<I>(set->preprocessed_counts);
+                map.reserve(size);
+                for(std::uint64_t i = 0; i < size; i++) {
+                    auto key = read_ngram<I + 1>(reader);
+                    map.try_emplace(key, reader.read<std::uint32_t>());
+                }
+            }
+            spdlog::info("Loaded {} {}-grams{} from checkpoint", size, I + 1, set->suffix);
+        });
+    }
+    ASSERT(reader.done());
+    return std::pair{checkpoint_phase, resume_month};
+}
+
+bool Aggregator::should_checkpoint(std::chrono::year_month month, std::chrono::year_month& last_checkpoint) {
+    if(options.checkpoint_interval == 0 || month - last_checkpoint < std::chrono::months(options.checkpoint_interval)) {
+        return false;
+    }
+    last_checkpoint = month;
+    return true;
 }
 
 bool Aggregator::blacklisted_timestamp(sys_ms timestamp) {
@@ -2,10 +2,19 @@
 #define AGGREGATOR_HPP
 
 #include <chrono>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
 #include <string_view>
 
-#include "MessageDatabaseManager.hpp"
+#include "MessageSource.hpp"
+#include "batched_lookup.hpp"
+#include "frozen_ngram_map.hpp"
+#include "lossy_counts.hpp"
 #include "ngram.hpp"
+#include "utils/blocked_bloom_filter.hpp"
+#include "utils/message_cache.hpp"
 
 #include <ankerl/unordered_dense.h>
 #include <duckdb.hpp>
@@ -13,52 +22,159 @@
 
 using namespace std::literals;
 
+enum class bucket_granularity : std::uint8_t { month, week, day };
+
+// what to do when the first pass goes over its memory budget
+enum class budget_action : std::uint8_t { spill, abort };
+
+struct AggregatorOptions {
+    // continue from the last checkpoint instead of starting over
+    bool resume = false;
+    // months between checkpoints, 0 disables checkpointing
+    int checkpoint_interval = 12;
+    // MiB of first-pass counts to keep in memory per width before spilling them to disk, 0 never spills
+    std::size_t spill_budget = 0;
+    // hard limit in MiB on the first-pass counts of all widths together, 0 for no limit
+    std::size_t memory_budget = 0;
+    budget_action over_budget = budget_action::spill;
+    // target false positive rate of the filters in front of the aggregation pass's lookups, 0 disables them
+    double bloom_fpr = 0.01;
+    // slots in the aggregation pass's cache of short repeated messages, 0 disables it
+    std::size_t message_cache_size = 1 << 16;
+    // Lossy counting for the first pass, messages per bucket, 0 disables. At the end of each bucket entries which can't
+    // have been seen more than once per bucket so far are dropped. Unverified, only ngrams counted at least the
+    // threshold since their last insertion are kept, so some above it can be missed but none below it are kept.
+    // Incompatible with spilling.
+    std::uint64_t prune_interval = 0;
+    // after a lossy first pass, recount the surviving candidates exactly with a second pass over the messages
+    bool verify_pruned = false;
+    // also count case folded ngrams, written to separate ngrams_ci_N and frequencies_ci tables
+    bool case_folded = false;
+    // Finer series are written to a series table in addition to the monthly frequencies table
+    bucket_granularity granularity = bucket_granularity::month;
+};
+
 class Aggregator {
 public:
-    Aggregator(MessageDatabaseManager& db, std::string_view nonce) : db(db), nonce(nonce) {}
+    Aggregator(MessageSource& db, std::string_view nonce, AggregatorOptions options)
+        : db(&db), nonce(nonce), options(options) {}
+    // for merging partial aggregates, which reads no messages
+    Aggregator(std::string_view nonce, AggregatorOptions options) : db(nullptr), nonce(nonce), options(options) {}
 
     void run();
+    // Worker mode, writes exact counts for the messages in [from, to) to a partial aggregate file for merge_partials
+    void run_partial(const std::filesystem::path& path, std::optional<sys_ms> from, std::optional<sys_ms> to);
+    // Builds and publishes the database from the partial aggregates of disjoint ranges
+    void merge_partials(std::span<const std::filesystem::path> paths);
 
 private:
     static constexpr std::chrono::year_month agg_epoch{std::chrono::year(2017), std::chrono::January};
+    // sub-month buckets are counted in whole days or weeks from here
+    static constexpr std::chrono::sys_days bucket_epoch{agg_epoch / 1};
     // april fool's 2023 is blacklisted, the logic can be expanded later if needed
     // https://discord.com/channels/331718482485837825/331881381477089282/1091618654405283940
     static constexpr sys_ms april_fools_2023_start{1680332568s};
     // https://discord.com/channels/331718482485837825/1091622651723784222/1092186981724848138
     static constexpr sys_ms april_fools_2023_end{1680468068s};
 
-    MessageDatabaseManager& db;
+    // The database is built under the staging name and published as ngrams-<version>.duckdb once complete, the
+    // version marker holds the current version. The server only follows the marker, it never sees a partial database.
+    inline static const std::filesystem::path staging_database_path = "ngrams.staging.duckdb";
+    inline static const std::filesystem::path version_marker_path = "ngrams.version";
+    inline static const std::filesystem::path checkpoint_path = "ngrams.checkpoint";
+    static constexpr std::uint64_t checkpoint_magic = 0x54504b434d415247; // "GRAMCKPT"
+    static constexpr std::uint32_t checkpoint_version = 8;
+    // completions are precomputed for prefixes of up to this many characters, the server filters longer ones
+    static constexpr std::size_t completion_prefix_limit = 32;
+    static constexpr std::size_t completions_per_prefix = 10;
+    inline static const std::filesystem::path spill_directory = "ngrams.spill";
+
+    enum class phase : std::uint8_t {
+        preprocess, // partway through the first pass
+        preprocessed, // first pass finished
+        aggregation // partway through the aggregation pass
+    };
+
+    MessageSource* db;
     std::string_view nonce;
+    AggregatorOptions options;
     std::optional<duckdb::DuckDB> aggdb; // using an optional here to defer construction
     std::optional<duckdb::Connection> con; // using an optional here to defer construction
     struct augmented_entry {
         std::uint32_t id;
         std::uint32_t count;
+        std::uint32_t total; // from the first pass
+        std::uint32_t bucket_count; // for the current sub-month bucket
         XoshiroCpp::Xoroshiro128Plus noise_source;
     };
-    using Counts = std::tuple<
-        ngram_map<1, std::uint32_t>,
-        ngram_map<2, std::uint32_t>,
-        ngram_map<3, std::uint32_t>,
-        ngram_map<4, std::uint32_t>,
-        ngram_map<5, std::uint32_t>
-    >;
-    using AugmentedCounts = std::tuple<
-        ngram_map<1, augmented_entry>,
-        ngram_map<2, augmented_entry>,
-        ngram_map<3, augmented_entry>,
-        ngram_map<4, augmented_entry>,
-        ngram_map<5, augmented_entry>
-    >;
-    Counts preprocessed_counts;
-    AugmentedCounts counts;
-
-    void preprocess();
-    void setup_ngram_maps();
-    void setup_database();
-    void populate_ngram_tables();
-    void do_flush(std::chrono::year_month date, std::uint64_t total_for_month);
-    void do_aggregation();
+    template<std::size_t N> using counts_map = ngram_map<N, std::uint32_t>;
+    // the surviving ngrams are fixed once the first pass is done
+    template<std::size_t N> using augmented_counts_map = frozen_ngram_map<N, augmented_entry>;
+    using Counts = per_width_tuple<counts_map>;
+    using AugmentedCounts = per_width_tuple<augmented_counts_map>;
+    // Everything counted for one set of tables, the exact ngrams or the case folded ones
+    struct count_set {
+        std::string_view suffix; // table name suffix
+        Counts preprocessed_counts;
+        per_width_tuple<lossy_counts_map> lossy_counts; // the first pass with --prune-interval, moved to the above after
+        AugmentedCounts counts;
+        // number of sorted runs spilled to disk for each width
+        std::array<std::size_t, ngram_max_width> spill_runs{};
+        // tokens counted for the month and the sub-month bucket being aggregated
+        std::uint64_t total_for_month = 0;
+        std::uint64_t total_for_bucket = 0;
+        // most aggregation lookups miss, the filters turn most misses away before the count maps are touched
+        std::array<blocked_bloom_filter, ngram_max_width> filters;
+        std::array<lookup_stats, ngram_max_width> filter_stats{};
+        struct cached_hit {
+            augmented_entry* entry; // stable, the frozen maps don't move entries
+            bool unigram;
+        };
+        message_cache<cached_hit> cache;
+    };
+    count_set exact{""};
+    count_set folded{"_ci"};
+    std::array<count_set*, 2> all_sets{&exact, &folded};
+    std::string folded_content; // scratch buffer
+    template<std::size_t N> using probe_batch = std::vector<ngram_probe<N>>;
+    per_width_tuple<probe_batch> probes; // scratch for one message's lookups
+    std::uint32_t prune_rounds = 0; // buckets at which the first pass was pruned
+
+    // the sets being counted
+    std::span<count_set* const> count_sets() const {
+        return std::span(all_sets).first(options.case_folded ? 2 : 1);
+    }
+
+    template<typename C> void for_each_message_set(std::string_view content, const C& callback);
+    void preprocess(std::optional<sys_ms> resume_from);
+    template<std::size_t I> void enforce_budgets();
+    void prune_counts();
+    void report_pruning();
+    void finish_lossy_counts();
+    void verify_pruned_counts();
+    static std::string memory_report();
+    template<std::size_t I> void spill();
+    void merge_spilled_runs();
+    static std::filesystem::path spill_run_path(const count_set& set, std::size_t width, std::size_t run);
+    void setup_ngram_maps(count_set& set);
+    template<std::size_t I> void build_filter(count_set& set);
+    void log_filter_stats(const count_set& set);
+    void setup_database(std::optional<std::chrono::year_month> resume_month);
+    void populate_ngram_tables(count_set& set);
+    void create_gram_indexes(const count_set& set);
+    void create_completions(const count_set& set);
+    void do_flush(count_set& set, std::chrono::year_month date);
+    std::int32_t bucket_of(sys_ms timestamp) const;
+    void flush_bucket(count_set& set, std::int32_t bucket, std::chrono::year_month date);
+    void count_message(count_set& set, std::string_view content, bool bucketed);
+    void do_aggregation(std::optional<sys_ms> resume_from);
+    void build_series(const count_set& set);
+    void publish_database();
+
+    // Checkpoints are taken at month boundaries and cover every message before resume_from
+    void write_checkpoint(phase current_phase, std::chrono::year_month resume_month);
+    std::optional<std::pair<phase, std::chrono::year_month>> load_checkpoint();
+    bool should_checkpoint(std::chrono::year_month month, std::chrono::year_month& last_checkpoint);
 
     bool blacklisted_timestamp(sys_ms timestamp);
 
@@ -18,7 +18,10 @@ MessageDatabaseManager::MessageDatabaseManager(const std::string& auth_url)
     load_channel_thread_stati();
 }
 
-MessageDatabaseReader MessageDatabaseManager::make_message_database_reader() {
+std::unique_ptr<MessageReader> MessageDatabaseManager::make_reader(
+    std::optional<sys_ms> start,
+    std::optional<sys_ms> end
+) {
     auto excluded_channels = private_channel_list();
     for(const auto& channel : blacklisted_channels) {
         excluded_channels.append(channel);
@@ -27,7 +30,8 @@ MessageDatabaseReader MessageDatabaseManager::make_message_database_reader() {
     for(const auto& bot_id : bot_ids) {
         excluded_authors.append(bot_id);
     }
-    auto filter = bsoncxx::builder::basic::make_document(
+    bsoncxx::builder::basic::document filter;
+    filter.append(
         bsoncxx::builder::basic::kvp(
             "channel",
             bsoncxx::builder::basic::make_document(bsoncxx::builder::basic::kvp("$nin", excluded_channels))
@@ -41,11 +45,22 @@ MessageDatabaseReader MessageDatabaseManager::make_message_database_reader() {
             bsoncxx::builder::basic::make_document(bsoncxx::builder::basic::kvp("$exists", false))
         )
     );
+    if(start || end) {
+        // timestamps are stored as doubles
+        bsoncxx::builder::basic::document range;
+        if(start) {
+            range.append(bsoncxx::builder::basic::kvp("$gte", double(start->time_since_epoch().count())));
+        }
+        if(end) {
+            range.append(bsoncxx::builder::basic::kvp("$lt", double(end->time_since_epoch().count())));
+        }
+        filter.append(bsoncxx::builder::basic::kvp("timestamp", range.extract()));
+    }
     mongocxx::options::find opts;
     opts.sort(bsoncxx::builder::basic::make_document(bsoncxx::builder::basic::kvp("timestamp", 1)));
     // std::cout<<bsoncxx::to_json(filter)<<std::endl;
-    auto cursor = db["message_database"].find(std::move(filter), std::move(opts));
-    return MessageDatabaseReader(std::move(cursor), private_channels);
+    auto cursor = db["message_database"].find(filter.extract(), std::move(opts));
+    return std::make_unique<MessageDatabaseReader>(std::move(cursor), private_channels);
 }
 
 bsoncxx::builder::basic::array MessageDatabaseManager::private_channel_list() const {
@@ -1,6 +1,8 @@
 #ifndef MESSAGEDATABASEMANAGER_HPP
 #define MESSAGEDATABASEMANAGER_HPP
 
+#include <memory>
+#include <optional>
 #include <string>
 
 #include <mongocxx/client.hpp>
@@ -8,8 +10,9 @@
 #include <bsoncxx/json.hpp>
 
 #include "MessageDatabaseReader.hpp"
+#include "MessageSource.hpp"
 
-class MessageDatabaseManager {
+class MessageDatabaseManager : public MessageSource {
     string_set private_channels;
     mongocxx::instance inst;
     mongocxx::client connection;
@@ -18,7 +21,10 @@ class MessageDatabaseManager {
 public:
     MessageDatabaseManager(const std::string& auth_url);
 
-    MessageDatabaseReader make_message_database_reader();
+    std::unique_ptr<MessageReader> make_reader(
+        std::optional<sys_ms> start = std::nullopt,
+        std::optional<sys_ms> end = std::nullopt
+    ) override;
 
 private:
     bsoncxx::builder::basic::array private_channel_list() const;
@@ -13,7 +13,7 @@
 MessageDatabaseReader::MessageDatabaseReader(mongocxx::cursor cursor, const string_set& private_channels)
     : cursor(std::move(cursor)),
         private_channels(private_channels),
-        read_thread(&MessageDatabaseReader::reader, this) {}
+        read_thread([this](std::stop_token stop) { reader(stop); }) {}
 
 [[gnu::noinline]] std::optional<MessageDatabaseEntry> MessageDatabaseReader::read() {
     while(!queue.front()) {}
@@ -41,12 +41,34 @@ MessageDatabaseEntry MessageDatabaseReader::parse_document(const bsoncxx::docume
     return MessageDatabaseEntry{timestamp, std::string(content)};
 }
 
-void MessageDatabaseReader::reader() {
+// Snowflakes are stored as strings, 0 if the field is missing or isn't a valid snowflake. Never excluded then, the
+// query's $nin lets documents without the field through too.
+static std::uint64_t snowflake_field(const bsoncxx::document::element& element) {
+    if(!element || element.type() != bsoncxx::type::k_string) {
+        return 0;
+    }
+    auto value = element.get_string().value;
+    return parse_snowflake(std::string_view{value.begin(), value.end()}).value_or(0);
+}
+
+// The reader can be destroyed before the cursor is exhausted, a full queue is waited on only until the jthread is asked
+// to stop
+bool MessageDatabaseReader::push(std::stop_token stop, std::optional<MessageDatabaseEntry> entry) {
+    while(!queue.try_emplace(std::move(entry))) {
+        if(stop.stop_requested()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MessageDatabaseReader::reader(std::stop_token stop) {
     for(const auto& doc : cursor) {
-        auto id_element = doc["channel"];
-        ASSERT(id_element.type() == bsoncxx::type::k_string);
-        auto id = id_element.get_string();
-        if(is_bot_id(id.value)) {
+        if(stop.stop_requested()) {
+            return;
+        }
+        // the query already excludes these, this is a cheap second line of defense
+        if(is_bot_id(snowflake_field(doc["author"]["id"])) || is_blacklisted_channel(snowflake_field(doc["channel"]))) {
             continue;
         }
 
@@ -57,7 +79,9 @@ void MessageDatabaseReader::reader() {
         //     continue;
         // }
 
-        queue.emplace(parse_document(doc));
+        if(!push(stop, parse_document(doc))) {
+            return;
+        }
 
         #ifdef TRACE
         if(count++ == 100'000) {
@@ -66,5 +90,5 @@ void MessageDatabaseReader::reader() {
         }
         #endif
     }
-    queue.emplace(std::nullopt);
+    push(stop, std::nullopt);
 }
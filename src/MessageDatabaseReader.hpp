@@ -1,6 +1,8 @@
 #ifndef MESSAGEDATABASEREADER_HPP
 #define MESSAGEDATABASEREADER_HPP
 
+#include <optional>
+#include <stop_token>
 #include <string>
 #include <thread>
 
@@ -8,14 +10,10 @@
 #include <bsoncxx/json.hpp>
 #include <rigtorp/SPSCQueue.h>
 
+#include "MessageSource.hpp"
 #include "utils.hpp"
 
-struct MessageDatabaseEntry {
-    sys_ms timestamp;
-    std::string content;
-};
-
-class MessageDatabaseReader {
+class MessageDatabaseReader : public MessageReader {
     mongocxx::cursor cursor;
     rigtorp::SPSCQueue<std::optional<MessageDatabaseEntry>> queue{1024};
     const string_set& private_channels;
@@ -27,12 +25,15 @@ class MessageDatabaseReader {
 public:
     MessageDatabaseReader(mongocxx::cursor cursor, const string_set& private_channels);
 
-    std::optional<MessageDatabaseEntry> read();
+    std::optional<MessageDatabaseEntry> read() override;
 
 private:
     MessageDatabaseEntry parse_document(const bsoncxx::document::view &doc);
 
-    void reader();
+    // false if the consumer went away while the queue was full
+    bool push(std::stop_token stop, std::optional<MessageDatabaseEntry> entry);
+
+    void reader(std::stop_token stop);
 };
 
 #endif
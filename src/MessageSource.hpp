@@ -0,0 +1,33 @@
+#ifndef MESSAGESOURCE_HPP
+#define MESSAGESOURCE_HPP
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "utils.hpp"
+
+struct MessageDatabaseEntry {
+    sys_ms timestamp;
+    std::string content;
+};
+
+// Stream of messages in timestamp order, std::nullopt once exhausted
+class MessageReader {
+public:
+    virtual ~MessageReader() = default;
+    virtual std::optional<MessageDatabaseEntry> read() = 0;
+};
+
+// Anything the aggregator can read messages from
+class MessageSource {
+public:
+    virtual ~MessageSource() = default;
+    // Messages are read in timestamp order, optionally only those in [start, end)
+    virtual std::unique_ptr<MessageReader> make_reader(
+        std::optional<sys_ms> start = std::nullopt,
+        std::optional<sys_ms> end = std::nullopt
+    ) = 0;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "SyntheticMessageSource.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <ranges>
+#include <string_view>
+
+#include <libassert/assert.hpp>
+#include <xoshiro-cpp/XoshiroCpp.hpp>
+
+using namespace std::literals;
+
+namespace {
+    // a few real words at the head of the distribution so that common queries return something sensible
+    constexpr std::array head_words = {
+        "the"sv, "i"sv, "to"sv, "a"sv, "you"sv, "is"sv, "it"sv, "and"sv, "of"sv, "that"sv, "in"sv, "c++"sv,
+        "std::vector"sv, "int"sv, "code"sv, "template"sv, "compiler"sv, "pointer"sv, "isn't"sv, "function"sv,
+    };
+
+    constexpr std::array syllables = {
+        "ka"sv, "lo"sv, "mi"sv, "ne"sv, "ru"sv, "to"sv, "sa"sv, "vi"sv, "de"sv, "po"sv, "ex"sv, "an"sv, "ti"sv,
+        "gu"sv, "ber"sv, "str"sv, "con"sv, "ing"sv, "ed"sv, "ptr"sv, "_"sv, "al"sv, "loc"sv, "ize"sv,
+    };
+
+    constexpr auto synthetic_epoch = std::chrono::sys_days(std::chrono::year(2017) / std::chrono::January / 1);
+
+    XoshiroCpp::Xoroshiro128Plus make_rng(std::uint64_t seed, std::uint64_t stream) {
+        return XoshiroCpp::Xoroshiro128Plus{seed ^ (stream * 0x9e3779b97f4a7c15)};
+    }
+
+    // uniform double [0, 1)
+    double uniform(XoshiroCpp::Xoroshiro128Plus& rng) {
+        return double(rng() >> 11) * 0x1.0p-53;
+    }
+
+    std::vector<double> zipf_cdf(std::size_t n, double exponent) {
+        std::vector<double> cdf(n);
+        double sum = 0;
+        for(std::size_t i = 0; i < n; i++) {
+            sum += 1 / std::pow(double(i + 1), exponent);
+            cdf[i] = sum;
+        }
+        for(auto& value : cdf) {
+            value /= sum;
+        }
+        return cdf;
+    }
+
+    std::size_t sample(const std::vector<double>& cdf, XoshiroCpp::Xoroshiro128Plus& rng) {
+        auto it = std::ranges::upper_bound(cdf, uniform(rng));
+        return std::min(std::size_t(it - cdf.begin()), cdf.size() - 1);
+    }
+}
+
+class SyntheticMessageReader : public MessageReader {
+    const SyntheticMessageSource& source;
+    std::uint64_t next;
+    std::uint64_t last;
+
+public:
+    SyntheticMessageReader(const SyntheticMessageSource& source, std::uint64_t first, std::uint64_t last)
+        : source(source), next(first), last(last) {}
+
+    std::optional<MessageDatabaseEntry> read() override {
+        if(next >= last) {
+            return std::nullopt;
+        }
+        auto message = next++;
+        return MessageDatabaseEntry{source.timestamp_of(message), source.content_of(message)};
+    }
+};
+
+SyntheticMessageSource::SyntheticMessageSource(SyntheticCorpusOptions options) : options(options) {
+    ASSERT(options.vocabulary > head_words.size());
+    ASSERT(options.months > 0);
+    auto rng = make_rng(options.seed, 0);
+    words.assign(head_words.begin(), head_words.end());
+    while(words.size() < options.vocabulary) {
+        std::string word;
+        auto length = 1 + rng() % 4;
+        for(std::size_t i = 0; i < length; i++) {
+            word += syllables[rng() % syllables.size()];
+        }
+        words.push_back(std::move(word));
+    }
+    word_cdf = zipf_cdf(words.size(), options.zipf_exponent);
+    // stock phrases give the wider tables popular entries rather than just independent words
+    for(std::size_t i = 0; i < options.vocabulary / 100; i++) {
+        std::string phrase;
+        auto length = 2 + rng() % 4;
+        for(std::size_t j = 0; j < length; j++) {
+            phrase += words[sample(word_cdf, rng)];
+            phrase += ' ';
+        }
+        phrases.push_back(std::move(phrase));
+    }
+    phrase_cdf = zipf_cdf(phrases.size(), options.zipf_exponent);
+}
+
+std::unique_ptr<MessageReader> SyntheticMessageSource::make_reader(
+    std::optional<sys_ms> start,
+    std::optional<sys_ms> end
+) {
+    // timestamps are monotonic in the message index
+    auto first_at = [&](sys_ms timestamp) {
+        return *std::ranges::partition_point(
+            std::views::iota(std::uint64_t(0), options.messages),
+            [&](std::uint64_t message) { return timestamp_of(message) < timestamp; }
+        );
+    };
+    std::uint64_t first = start ? first_at(*start) : 0;
+    std::uint64_t last = end ? first_at(*end) : options.messages;
+    return std::make_unique<SyntheticMessageReader>(*this, first, last);
+}
+
+sys_ms SyntheticMessageSource::timestamp_of(std::uint64_t message) const {
+    auto end = std::chrono::sys_days(
+        std::chrono::year_month_day(synthetic_epoch) + std::chrono::months(options.months)
+    );
+    auto span = std::chrono::duration_cast<std::chrono::milliseconds>(end - synthetic_epoch);
+    return synthetic_epoch + std::chrono::milliseconds(
+        std::int64_t(double(span.count()) * double(message) / double(options.messages))
+    );
+}
+
+std::string SyntheticMessageSource::content_of(std::uint64_t message) const {
+    // every message is generated from its own stream so that readers can start anywhere
+    auto rng = make_rng(options.seed, message + 1);
+    std::string content;
+    auto length = 1 + rng() % 24;
+    for(std::size_t i = 0; i < length; i++) {
+        auto roll = uniform(rng);
+        if(roll < 0.05) {
+            content += phrases[sample(phrase_cdf, rng)];
+            continue;
+        }
+        auto word = words[sample(word_cdf, rng)];
+        if(roll < 0.15) {
+            word[0] = char(std::toupper(static_cast<unsigned char>(word[0])));
+        }
+        content += word;
+        content += roll < 0.2 ? ". " : " ";
+    }
+    return content;
+}
@@ -0,0 +1,46 @@
+#ifndef SYNTHETICMESSAGESOURCE_HPP
+#define SYNTHETICMESSAGESOURCE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "MessageSource.hpp"
+
+struct SyntheticCorpusOptions {
+    std::uint64_t messages = 0;
+    std::uint64_t seed = 1;
+    std::size_t vocabulary = 50'000;
+    double zipf_exponent = 1.07;
+    int months = 96;
+};
+
+// Deterministic generated corpus with Zipf distributed words and a set of stock phrases, for producing realistic
+// enough databases for benchmarking and load testing without access to the message database. Messages are spread
+// evenly over the configured number of months starting in January 2017.
+class SyntheticMessageSource : public MessageSource {
+    SyntheticCorpusOptions options;
+    std::vector<std::string> words;
+    std::vector<double> word_cdf;
+    std::vector<std::string> phrases;
+    std::vector<double> phrase_cdf;
+
+public:
+    SyntheticMessageSource(SyntheticCorpusOptions options);
+
+    std::unique_ptr<MessageReader> make_reader(
+        std::optional<sys_ms> start = std::nullopt,
+        std::optional<sys_ms> end = std::nullopt
+    ) override;
+
+    sys_ms timestamp_of(std::uint64_t message) const;
+    std::string content_of(std::uint64_t message) const;
+    std::uint64_t messages() const {
+        return options.messages;
+    }
+};
+
+#endif
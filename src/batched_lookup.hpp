@@ -0,0 +1,65 @@
+#ifndef BATCHED_LOOKUP_HPP
+#define BATCHED_LOOKUP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "frozen_ngram_map.hpp"
+#include "ngram.hpp"
+#include "utils/blocked_bloom_filter.hpp"
+
+struct lookup_stats {
+    std::uint64_t rejected = 0; // turned away without probing the map, by the filter or because the map is empty
+    std::uint64_t false_positives = 0; // passed the filter but not in the map
+    std::uint64_t hits = 0;
+};
+
+template<std::size_t N>
+struct ngram_probe {
+    ngram_view<N> key;
+    std::uint64_t hash;
+    std::size_t slot = 0;
+};
+
+// Resolves a batch of probes with group prefetching: every probe's filter block and pilot are prefetched, then the
+// probes that pass the filter have their slots computed and prefetched, then the keys are compared. Each sweep's
+// cache misses overlap instead of every probe waiting on the previous one. The batch is reused as scratch.
+template<std::size_t N, typename T, typename C>
+void batched_lookup(
+    frozen_ngram_map<N, T>& map,
+    const blocked_bloom_filter& filter,
+    std::vector<ngram_probe<N>>& batch,
+    lookup_stats& stats,
+    const C& on_hit
+) {
+    if(map.empty()) {
+        stats.rejected += batch.size();
+        return;
+    }
+    for(const auto& probe : batch) {
+        filter.prefetch(probe.hash);
+        map.prefetch_pilot(probe.hash);
+    }
+    std::size_t kept = 0;
+    for(auto& probe : batch) {
+        if(!filter.may_contain(probe.hash)) {
+            stats.rejected++;
+            continue;
+        }
+        probe.slot = map.slot_for(probe.hash);
+        map.prefetch_slot(probe.slot);
+        batch[kept++] = probe;
+    }
+    for(std::size_t i = 0; i < kept; i++) {
+        const auto& probe = batch[i];
+        if(auto it = map.find_in_slot(probe.key, probe.hash, probe.slot); it == map.end()) {
+            stats.false_positives++;
+        } else {
+            stats.hits++;
+            on_hit(it->second);
+        }
+    }
+}
+
+#endif
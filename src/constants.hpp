@@ -2,9 +2,12 @@
 #define CONSTANTS_HPP
 
 #include <array>
+#include <cstdint>
 #include <string_view>
 #include <algorithm>
 
+#include "utils.hpp"
+
 using namespace std::literals;
 
 constexpr std::array bot_ids = {
@@ -20,12 +23,24 @@ constexpr std::array blacklisted_channels = {
     "921113903574958080"sv // serious-off-topic
 };
 
-inline bool is_bot_id(std::string_view sv) {
-    return std::ranges::contains(bot_ids, sv);
+constexpr snowflake_set bot_id_set{bot_ids};
+constexpr snowflake_set blacklisted_channel_set{blacklisted_channels};
+
+inline bool is_bot_id(std::uint64_t id) {
+    return bot_id_set.contains(id);
+}
+
+inline bool is_blacklisted_channel(std::uint64_t id) {
+    return blacklisted_channel_set.contains(id);
 }
 
 constexpr std::size_t minimum_occurrences = 40;
 
-constexpr std::size_t ngram_max_width = 5;
+// configured by the build, see NGRAM_MAX_WIDTH in CMakeLists.txt
+#ifndef NGRAM_MAX_WIDTH
+ #define NGRAM_MAX_WIDTH 5
+#endif
+constexpr std::size_t ngram_max_width = NGRAM_MAX_WIDTH;
+static_assert(ngram_max_width >= 1 && ngram_max_width <= 255);
 
 #endif
@@ -0,0 +1,269 @@
+#ifndef FROZEN_NGRAM_MAP_HPP
+#define FROZEN_NGRAM_MAP_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <ankerl/unordered_dense.h>
+
+#include "ngram.hpp"
+#include "utils/memory_accounting.hpp"
+
+// Read-only map for a fixed set of ngrams, built once the survivors of the first pass are known. Keys are placed with
+// a minimal perfect hash in the style of PTHash: keys are split into buckets of about three, and each bucket gets a
+// pilot value chosen so that all of its keys land in distinct free slots. Keys are placed in a table 1% larger than
+// needed, which keeps the search for the last buckets short, and the few that land past the end are remapped to the
+// slots left free. A lookup is one pilot read, one fingerprint read, and only on a fingerprint match a key comparison
+// against the slot array. Most probes during aggregation are for ngrams that didn't survive, nearly all of which are
+// rejected by the fingerprint. Values stay mutable. Iteration is in slot order, for_each_in_order visits the entries in
+// the order they were given instead.
+template<std::size_t N, typename T>
+class frozen_ngram_map {
+public:
+    using value_type = std::pair<packed_ngram<N>, T>;
+    using iterator = value_type*;
+    using const_iterator = const value_type*;
+
+private:
+    template<typename U> using vector = std::vector<U, accounted_allocator<U, ngram_memory<N>>>;
+    static constexpr std::size_t keys_per_bucket = 3;
+    // Keys with distinct hashes place within a few hundred pilots at worst, a bucket which runs out of them restarts
+    // the search with another seed, like PTHash does
+    static constexpr std::uint64_t max_pilot = std::uint64_t(1) << 16;
+    static constexpr std::size_t max_seeds = 8;
+
+    vector<value_type> slots;
+    vector<std::uint8_t> fingerprints;
+    vector<std::uint32_t> pilots;
+    vector<std::uint32_t> remapped; // for positions past the end of slots
+    vector<std::uint32_t> order; // slot of each entry in construction order
+    std::size_t table_size = 0;
+    std::uint64_t seed = 0;
+
+    static std::uint64_t fastrange(std::uint64_t hash, std::size_t n) {
+        return std::uint64_t((static_cast<unsigned __int128>(hash) * n) >> 64);
+    }
+
+    std::size_t bucket_of(std::uint64_t hash) const {
+        return fastrange(hash, pilots.size());
+    }
+
+    std::size_t slot_of(std::uint64_t hash, std::uint64_t pilot) const {
+        auto mixed = ankerl::unordered_dense::detail::wyhash::hash(hash ^ seed ^ (pilot * 0x9e3779b97f4a7c15));
+        return fastrange(mixed, table_size);
+    }
+
+    // the bucket is chosen by the high bits, the low byte is close to independent of it
+    static std::uint8_t fingerprint_of(std::uint64_t hash) {
+        return std::uint8_t(hash);
+    }
+
+public:
+    frozen_ngram_map() = default;
+
+    explicit frozen_ngram_map(std::vector<value_type>&& entries) {
+        const std::size_t n = entries.size();
+        if(n == 0) {
+            return;
+        }
+        std::vector<std::uint64_t> hashes(n);
+        for(std::size_t i = 0; i < n; i++) {
+            hashes[i] = ngram_hash{}(entries[i].first);
+        }
+        table_size = n + (n + 99) / 100;
+        pilots.assign(std::max<std::size_t>(1, n / keys_per_bucket), 0);
+        slots.reserve(n);
+        // counting sort of the keys by bucket, then of the buckets by size, largest first
+        std::vector<std::uint32_t> bucket_start(pilots.size() + 1);
+        for(auto hash : hashes) {
+            bucket_start[bucket_of(hash) + 1]++;
+        }
+        std::size_t max_bucket_size = 0;
+        for(std::size_t b = 0; b < pilots.size(); b++) {
+            max_bucket_size = std::max<std::size_t>(max_bucket_size, bucket_start[b + 1]);
+            bucket_start[b + 1] += bucket_start[b];
+        }
+        std::vector<std::uint32_t> bucket_keys(n);
+        {
+            auto cursor = bucket_start;
+            for(std::size_t i = 0; i < n; i++) {
+                bucket_keys[cursor[bucket_of(hashes[i])]++] = std::uint32_t(i);
+            }
+        }
+        std::vector<std::vector<std::uint32_t>> buckets_by_size(max_bucket_size + 1);
+        for(std::size_t b = 0; b < pilots.size(); b++) {
+            buckets_by_size[bucket_start[b + 1] - bucket_start[b]].push_back(std::uint32_t(b));
+        }
+        // keys sharing a full hash can't be told apart by any pilot or seed
+        for(std::size_t b = 0; b < pilots.size(); b++) {
+            for(auto i = bucket_start[b]; i < bucket_start[b + 1]; i++) {
+                for(auto j = i + 1; j < bucket_start[b + 1]; j++) {
+                    if(hashes[bucket_keys[i]] == hashes[bucket_keys[j]]) {
+                        throw std::runtime_error("Unable to build a perfect hash, duplicate key hashes");
+                    }
+                }
+            }
+        }
+        std::vector<bool> taken;
+        std::vector<std::uint32_t> placement(table_size);
+        std::vector<std::size_t> positions;
+        // false if a bucket ran out of pilots
+        auto place_bucket = [&](std::size_t bucket, std::span<const std::uint32_t> keys) {
+            for(std::uint64_t pilot = 0; pilot < max_pilot; pilot++) {
+                positions.clear();
+                bool ok = true;
+                for(auto key : keys) {
+                    auto slot = slot_of(hashes[key], pilot);
+                    if(taken[slot] || std::ranges::contains(positions, slot)) {
+                        ok = false;
+                        break;
+                    }
+                    positions.push_back(slot);
+                }
+                if(ok) {
+                    pilots[bucket] = std::uint32_t(pilot);
+                    for(std::size_t i = 0; i < keys.size(); i++) {
+                        taken[positions[i]] = true;
+                        placement[positions[i]] = keys[i];
+                    }
+                    return true;
+                }
+            }
+            return false;
+        };
+        auto place_buckets = [&] {
+            taken.assign(table_size, false);
+            for(std::size_t size = max_bucket_size; size > 0; size--) {
+                for(auto bucket : buckets_by_size[size]) {
+                    if(!place_bucket(bucket, std::span(bucket_keys).subspan(bucket_start[bucket], size))) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+        for(std::size_t attempt = 0; !place_buckets(); attempt++) {
+            if(attempt + 1 == max_seeds) {
+                throw std::runtime_error("Unable to build a perfect hash, no seed placed every bucket");
+            }
+            seed = ankerl::unordered_dense::detail::wyhash::hash(attempt + 1);
+        }
+        // each key placed past the end moves into one of the free slots below n, there are exactly as many
+        std::size_t free_slot = 0;
+        remapped.resize(table_size - n);
+        for(std::size_t position = n; position < table_size; position++) {
+            if(taken[position]) {
+                while(taken[free_slot]) {
+                    free_slot++;
+                }
+                taken[free_slot] = true;
+                placement[free_slot] = placement[position];
+                remapped[position - n] = std::uint32_t(free_slot);
+            }
+        }
+        fingerprints.resize(n);
+        order.resize(n);
+        for(std::size_t slot = 0; slot < n; slot++) {
+            slots.push_back(std::move(entries[placement[slot]]));
+            fingerprints[slot] = fingerprint_of(hashes[placement[slot]]);
+            order[placement[slot]] = std::uint32_t(slot);
+        }
+        entries = {};
+    }
+
+    // Lookups in stages, for callers resolving many keys at once: prefetch the key's pilot, then find its slot and
+    // prefetch that, then compare
+    void prefetch_pilot(std::uint64_t hash) const {
+        if(!pilots.empty()) {
+            __builtin_prefetch(&pilots[bucket_of(hash)]);
+        }
+    }
+
+    std::size_t slot_for(std::uint64_t hash) const {
+        auto slot = slot_of(hash, pilots[bucket_of(hash)]);
+        if(slot >= slots.size()) [[unlikely]] {
+            slot = remapped[slot - slots.size()];
+        }
+        return slot;
+    }
+
+    void prefetch_slot(std::size_t slot) const {
+        __builtin_prefetch(&fingerprints[slot]);
+        __builtin_prefetch(&slots[slot]);
+    }
+
+    template<typename K>
+    iterator find_in_slot(const K& key, std::uint64_t hash, std::size_t slot) {
+        if(fingerprints[slot] != fingerprint_of(hash) || !(slots[slot].first == key)) {
+            return end();
+        }
+        return &slots[slot];
+    }
+
+    // for callers which already have ngram_hash{}(key)
+    template<typename K>
+    iterator find(const K& key, std::uint64_t hash) {
+        if(slots.empty()) {
+            return end();
+        }
+        return find_in_slot(key, hash, slot_for(hash));
+    }
+
+    template<typename K>
+    iterator find(const K& key) {
+        return find(key, ngram_hash{}(key));
+    }
+
+    template<typename K>
+    const_iterator find(const K& key) const {
+        return const_cast<frozen_ngram_map*>(this)->find(key);
+    }
+
+    // Consecutive entries are scattered across the table, the next few are prefetched
+    template<typename C>
+    void for_each_in_order(const C& callback) {
+        constexpr std::size_t lookahead = 8;
+        for(std::size_t i = 0; i < order.size(); i++) {
+            if(i + lookahead < order.size()) {
+                __builtin_prefetch(&slots[order[i + lookahead]]);
+            }
+            callback(slots[order[i]]);
+        }
+    }
+
+    template<typename C>
+    void for_each_in_order(const C& callback) const {
+        const_cast<frozen_ngram_map*>(this)->for_each_in_order([&](const value_type& entry) { callback(entry); });
+    }
+
+    std::size_t size() const {
+        return slots.size();
+    }
+
+    bool empty() const {
+        return slots.empty();
+    }
+
+    iterator begin() {
+        return slots.data();
+    }
+
+    iterator end() {
+        return slots.data() + slots.size();
+    }
+
+    const_iterator begin() const {
+        return slots.data();
+    }
+
+    const_iterator end() const {
+        return slots.data() + slots.size();
+    }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef LOSSY_COUNTS_HPP
+#define LOSSY_COUNTS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "ngram.hpp"
+#include "utils/arena.hpp"
+
+// Lossy counting (Manku and Motwani). The stream is cut into buckets and at the end of bucket b every entry whose
+// count plus error is at most b is evicted. An entry's count is exact since its (re)insertion and its error bounds what
+// was missed before it: the number of buckets ended when it was inserted. So the true count is within
+// [count, count + error], and an evicted entry had been seen at most once per bucket so far.
+struct lossy_count {
+    std::uint32_t count;
+    std::uint32_t error;
+};
+
+template<std::size_t N> using lossy_counts_map = ngram_map<N, lossy_count>;
+
+// Counts one occurrence, `buckets` is the number of buckets ended so far. Returns whether the entry is new.
+template<std::size_t N, typename K>
+bool add_lossy_count(lossy_counts_map<N>& map, const K& ngram, std::uint32_t buckets) {
+    auto [it, inserted] = map.try_emplace(ngram, lossy_count{0, buckets});
+    it->second.count++;
+    return inserted;
+}
+
+// Evicts entries at the end of bucket `buckets` and moves the overflowed keys of the rest to `arena`. Once this ran on
+// every map of the width, swapping `arena` into packed_ngram<N>::arena() releases the evicted keys' storage.
+template<std::size_t N>
+std::size_t prune_lossy_counts(lossy_counts_map<N>& map, std::uint32_t buckets, monotonic_arena& arena) {
+    auto values = map.extract();
+    auto before = values.size();
+    std::erase_if(values, [&](const auto& entry) { return entry.second.count + entry.second.error <= buckets; });
+    auto evicted = before - values.size();
+    for(auto& entry : values) {
+        entry.first.relocate(arena);
+    }
+    values.shrink_to_fit();
+    map.replace(std::move(values));
+    return evicted;
+}
+
+#endif
@@ -1,4 +1,9 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
+#include <optional>
+#include <vector>
 
 #include <cpptrace/cpptrace.hpp>
 #include <cpptrace/from_current.hpp>
@@ -10,20 +15,90 @@
 #include <lyra/lyra.hpp>
 
 #include "Aggregator.hpp"
+#include "MessageDatabaseManager.hpp"
+#include "SyntheticMessageSource.hpp"
 
 using namespace std::literals;
 
 template<> struct fmt::formatter<lyra::cli> : ostream_formatter {};
 
+// YYYY-MM-DD, as the start of that day in UTC
+std::optional<sys_ms> parse_date(const std::string& str) {
+    int year;
+    unsigned month;
+    unsigned day;
+    char trailing;
+    if(std::sscanf(str.c_str(), "%d-%u-%u%c", &year, &month, &day, &trailing) != 3) {
+        return std::nullopt;
+    }
+    std::chrono::year_month_day date{std::chrono::year(year), std::chrono::month(month), std::chrono::day(day)};
+    if(!date.ok()) {
+        return std::nullopt;
+    }
+    return std::chrono::sys_days(date);
+}
+
 int main(int argc, char** argv) CPPTRACE_TRY {
     bool show_help = false;
     std::string log_level = "info";
     std::string noise_nonce;
+    std::string granularity = "month";
+    std::string over_budget = "spill";
+    std::string partial_path;
+    std::string partial_from;
+    std::string partial_to;
+    bool merging = false;
+    std::vector<std::string> merge_paths;
+    AggregatorOptions options;
+    SyntheticCorpusOptions synthetic;
     auto cli = lyra::cli()
         | lyra::help(show_help)
         | lyra::opt(log_level, "log level")["--log-level"]("Spdlog log level")
             .choices("trace", "debug", "info", "warn", "err", "critical", "off")
-        | lyra::opt(noise_nonce, "string")["--nonce"]("Nonce used for noise seeding").required();
+        | lyra::opt(noise_nonce, "string")["--nonce"]("Nonce used for noise seeding").required()
+        | lyra::opt(options.resume)["--resume"]("Resume from the last checkpoint")
+        | lyra::opt(options.checkpoint_interval, "months")["--checkpoint-interval"](
+            "Months of messages between checkpoints, 0 to disable"
+        )
+        | lyra::opt(options.spill_budget, "MiB")["--spill-budget"](
+            "Memory budget per ngram width for first-pass counts before spilling sorted runs to disk, 0 to disable"
+        )
+        | lyra::opt(options.memory_budget, "MiB")["--memory-budget"](
+            "Hard memory budget for first-pass counts across all widths, 0 to disable"
+        )
+        | lyra::opt(over_budget, "action")["--over-budget"](
+            "What to do when over the memory budget: spill the largest width to disk or abort with a report"
+        ).choices("spill", "abort")
+        | lyra::opt(options.prune_interval, "messages")["--prune-interval"](
+            "Lossy first pass: prune the counts every this many messages, 0 to count exactly"
+        )
+        | lyra::opt(options.verify_pruned)["--verify-pruned"](
+            "Recount the candidates left by a lossy first pass exactly with a second pass over the messages"
+        )
+        | lyra::opt(options.bloom_fpr, "rate")["--bloom-fpr"](
+            "False positive rate of the filters in front of aggregation lookups, 0 to disable them"
+        )
+        | lyra::opt(options.message_cache_size, "slots")["--message-cache"](
+            "Slots in the aggregation pass's cache of short repeated messages, 0 to disable it"
+        )
+        | lyra::opt(options.case_folded)["--case-folded"](
+            "Also count case folded ngrams into separate ngrams_ci_N and frequencies_ci tables"
+        )
+        | lyra::opt(granularity, "granularity")["--granularity"](
+            "Also write weekly or daily series to a series table, frequencies stays monthly"
+        ).choices("month", "week", "day")
+        | lyra::opt(synthetic.messages, "count")["--synthetic"](
+            "Aggregate a generated corpus of this many messages instead of the message database"
+        )
+        | lyra::opt(synthetic.seed, "seed")["--synthetic-seed"]("Seed for the generated corpus")
+        | lyra::opt(partial_path, "path")["--partial"](
+            "Worker mode: count the messages from --from to --to into a partial aggregate file for merge"
+        )
+        | lyra::opt(partial_from, "YYYY-MM-DD")["--from"]("Start of a worker's range, inclusive")
+        | lyra::opt(partial_to, "YYYY-MM-DD")["--to"]("End of a worker's range, exclusive")
+        | lyra::command("merge", [&](const lyra::group&) { merging = true; })
+            .help("Combine partial aggregate files of disjoint ranges into a new database")
+            .add_argument(lyra::arg(merge_paths, "partial").cardinality(1, 0).help("Partial aggregate files"));
     if(auto result = cli.parse({ argc, argv }); !result) {
         fmt::println(stderr, "Error in command line: {}", result.message());
         return 1;
@@ -33,15 +108,57 @@ int main(int argc, char** argv) CPPTRACE_TRY {
         return 0;
     }
     spdlog::set_level(spdlog::level::from_str(log_level));
+    options.granularity = granularity == "day" ? bucket_granularity::day
+        : granularity == "week" ? bucket_granularity::week
+        : bucket_granularity::month;
+    options.over_budget = over_budget == "abort" ? budget_action::abort : budget_action::spill;
+    if(!(options.bloom_fpr >= 0 && options.bloom_fpr < 1)) {
+        fmt::println(stderr, "Error in command line: --bloom-fpr must be at least 0 and below 1");
+        return 1;
+    }
+    std::optional<sys_ms> from;
+    std::optional<sys_ms> to;
+    if(!partial_from.empty() && !(from = parse_date(partial_from))) {
+        fmt::println(stderr, "Error in command line: --from {} is not a YYYY-MM-DD date", partial_from);
+        return 1;
+    }
+    if(!partial_to.empty() && !(to = parse_date(partial_to))) {
+        fmt::println(stderr, "Error in command line: --to {} is not a YYYY-MM-DD date", partial_to);
+        return 1;
+    }
+    if(partial_path.empty() && (from || to)) {
+        fmt::println(stderr, "Error in command line: --from and --to are only for --partial");
+        return 1;
+    }
 
     spdlog::info("Starting up");
+    if(merging) {
+        std::vector<std::filesystem::path> paths(merge_paths.begin(), merge_paths.end());
+        Aggregator{noise_nonce, options}.merge_partials(paths);
+        return 0;
+    }
+    auto aggregate = [&](MessageSource& source) {
+        Aggregator aggregator{source, noise_nonce, options};
+        if(!partial_path.empty()) {
+            aggregator.run_partial(partial_path, from, to);
+        } else {
+            aggregator.run();
+        }
+    };
+    if(synthetic.messages != 0) {
+        spdlog::info("Generating synthetic corpus of {} messages", synthetic.messages);
+        SyntheticMessageSource source(synthetic);
+        aggregate(source);
+        return 0;
+    }
+
     std::ifstream auth_file("auth.txt");
     std::string auth_url{std::istreambuf_iterator<char>(auth_file), std::istreambuf_iterator<char>()};
 
     spdlog::info("Setting up database connection");
     MessageDatabaseManager db(auth_url);
 
-    Aggregator{db, noise_nonce}.run();
+    aggregate(db);
 } CPPTRACE_CATCH(const std::exception& e) {
     fmt::println(stderr, "Caught exception {}: {}", cpptrace::demangle(typeid(e).name()), e.what());
     cpptrace::from_current_exception().print();
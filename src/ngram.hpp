@@ -2,6 +2,9 @@
 #define NGRAM_HPP
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
 #include <ranges>
 #include <span>
 #include <utility>
@@ -12,6 +15,8 @@
 
 #include "constants.hpp"
 #include "utils.hpp"
+#include "utils/arena.hpp"
+#include "utils/memory_accounting.hpp"
 
 template<typename T, std::size_t N> requires(N >= 1)
 class ngram_tmpl {
@@ -19,6 +24,8 @@ class ngram_tmpl {
 public:
     ngram_tmpl() = default;
 
+    explicit ngram_tmpl(const T& gram) requires(N == 1) : grams{gram} {}
+
     template<typename U>
     ngram_tmpl(std::span<U> data) {
         ASSERT(data.size() <= N);
@@ -83,21 +90,216 @@ using ngram = ngram_tmpl<std::string, N>;
 template<std::size_t N>
 using ngram_view = ngram_tmpl<std::string_view, N>;
 
+// Compact key for ngram maps. All grams are packed into one fixed size buffer as N length bytes followed by the gram
+// contents, zero padded so equal keys have identical bytes. Keys which don't fit inline go in an overflow arena, one
+// arena per width, and the buffer holds a pointer to N uint32 lengths followed by the contents.
+template<std::size_t N> requires(N >= 1)
+class packed_ngram {
+public:
+    static constexpr std::size_t storage_size = 8 * N + 8;
+private:
+    static constexpr unsigned char overflow_marker = 0xff;
+    std::array<char, storage_size> storage{};
+
+    bool overflowed() const {
+        return static_cast<unsigned char>(storage[0]) == overflow_marker;
+    }
+
+    const char* overflow_pointer() const {
+        const char* pointer;
+        std::memcpy(&pointer, storage.data() + 8, sizeof(pointer));
+        return pointer;
+    }
+
+    std::size_t length(std::size_t i) const {
+        if(overflowed()) {
+            std::uint32_t length;
+            std::memcpy(&length, overflow_pointer() + i * sizeof(length), sizeof(length));
+            return length;
+        } else {
+            return static_cast<unsigned char>(storage[i]);
+        }
+    }
+
+    const char* data() const {
+        return overflowed() ? overflow_pointer() + N * sizeof(std::uint32_t) : storage.data() + N;
+    }
+
+public:
+    class iterator {
+        const packed_ngram* ngram = nullptr;
+        std::size_t index = 0;
+        std::size_t offset = 0;
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        iterator(const packed_ngram* ngram, std::size_t index) : ngram(ngram), index(index) {}
+
+        std::string_view operator*() const {
+            return {ngram->data() + offset, ngram->length(index)};
+        }
+
+        iterator& operator++() {
+            offset += ngram->length(index);
+            index++;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const iterator& other) const {
+            return index == other.index;
+        }
+    };
+
+    packed_ngram() = default;
+
+    template<typename T>
+    packed_ngram(const ngram_tmpl<T, N>& ngram) {
+        std::size_t total = 0;
+        for(const auto& part : ngram) {
+            total += std::string_view(part).size();
+        }
+        char* out;
+        // inline lengths are single bytes and a first length of 0xff would read as the overflow marker, which wide
+        // enough keys could otherwise hold
+        if(N + total <= storage_size && total < overflow_marker) {
+            for(std::size_t i = 0; const auto& part : ngram) {
+                storage[i++] = char(std::string_view(part).size());
+            }
+            out = storage.data() + N;
+        } else {
+            char* block = arena().allocate(N * sizeof(std::uint32_t) + total);
+            for(std::size_t i = 0; const auto& part : ngram) {
+                auto length = std::uint32_t(std::string_view(part).size());
+                std::memcpy(block + i++ * sizeof(length), &length, sizeof(length));
+            }
+            storage[0] = char(overflow_marker);
+            std::memcpy(storage.data() + 8, &block, sizeof(block));
+            out = block + N * sizeof(std::uint32_t);
+        }
+        for(const auto& part : ngram) {
+            std::string_view view = part;
+            std::memcpy(out, view.data(), view.size());
+            out += view.size();
+        }
+    }
+
+    static monotonic_arena& arena() {
+        static monotonic_arena overflow_arena;
+        return overflow_arena;
+    }
+
+    // Copies an overflowed key's lengths and contents into another arena. Erased keys' storage is only released by
+    // moving every live key of the width to a fresh arena and swapping it in.
+    void relocate(monotonic_arena& to) {
+        if(!overflowed()) {
+            return;
+        }
+        std::size_t size = N * sizeof(std::uint32_t);
+        for(std::size_t i = 0; i < N; i++) {
+            size += length(i);
+        }
+        char* block = to.allocate(size);
+        std::memcpy(block, overflow_pointer(), size);
+        std::memcpy(storage.data() + 8, &block, sizeof(block));
+    }
+
+    auto size() const {
+        return N;
+    }
+
+    std::string_view operator[](std::size_t i) const {
+        std::size_t offset = 0;
+        for(std::size_t j = 0; j < i; j++) {
+            offset += length(j);
+        }
+        return {data() + offset, length(i)};
+    }
+
+    iterator begin() const {
+        return {this, 0};
+    }
+
+    iterator end() const {
+        return {this, N};
+    }
+
+    bool operator==(const packed_ngram& other) const {
+        if(!overflowed() && !other.overflowed()) {
+            return storage == other.storage;
+        }
+        return std::ranges::equal(*this, other);
+    }
+
+    template<typename T>
+    bool operator==(const ngram_tmpl<T, N>& other) const {
+        return std::ranges::equal(*this, other, [](std::string_view a, std::string_view b) { return a == b; });
+    }
+};
+
 struct ngram_hash {
     using is_transparent = void; // enable heterogeneous overloads
     using is_avalanching = void; // mark class as high quality avalanching hash
 
+    // all representations of an ngram hash the same as their string_view grams
     template<typename T, std::size_t N>
     [[nodiscard]] auto operator()(const ngram_tmpl<T, N>& ngram) const noexcept -> uint64_t {
         std::size_t hash = 0;
         for(const auto& part : ngram) {
+            hash_combine(hash, std::string_view(part));
+        }
+        return hash;
+    }
+
+    template<std::size_t N>
+    [[nodiscard]] auto operator()(const packed_ngram<N>& ngram) const noexcept -> uint64_t {
+        std::size_t hash = 0;
+        for(auto part : ngram) {
             hash_combine(hash, part);
         }
         return hash;
     }
 };
 
-template<std::size_t N, typename T> using ngram_map = ankerl::unordered_dense::map<ngram<N>, T, ngram_hash, std::equal_to<>>;
+// Memory held by ngram maps of width N, their entries and buckets plus the overflow arena for their keys
+template<std::size_t N>
+struct ngram_memory {
+    static memory_account& account() {
+        static memory_account maps;
+        return maps;
+    }
+
+    static std::size_t bytes() {
+        return account().bytes() + packed_ngram<N>::arena().capacity();
+    }
+};
+
+template<std::size_t N, typename T>
+using ngram_map = ankerl::unordered_dense::map<
+    packed_ngram<N>,
+    T,
+    ngram_hash,
+    std::equal_to<>,
+    accounted_allocator<std::pair<packed_ngram<N>, T>, ngram_memory<N>>
+>;
+
+template<template<std::size_t> typename T, typename S> struct per_width_tuple_impl;
+template<template<std::size_t> typename T, std::size_t... I>
+struct per_width_tuple_impl<T, std::index_sequence<I...>> {
+    using type = std::tuple<T<I + 1>...>;
+};
+
+// std::tuple<T<1>, T<2>, ..., T<W>>, used to hold one of something for each ngram width
+template<template<std::size_t> typename T, std::size_t W = ngram_max_width>
+using per_width_tuple = typename per_width_tuple_impl<T, std::make_index_sequence<W>>::type;
 
 template<typename T, std::size_t N>
 struct fmt::formatter<ngram_tmpl<T, N>> {
@@ -110,6 +312,17 @@ struct fmt::formatter<ngram_tmpl<T, N>> {
     }
 };
 
+template<std::size_t N>
+struct fmt::formatter<packed_ngram<N>> {
+    constexpr auto parse(format_parse_context& ctx) {
+        return ctx.begin();
+    }
+
+    auto format(const packed_ngram<N>& ngram, format_context& ctx) const {
+        return fmt::format_to(ctx.out(), "{}", fmt::join(ngram, ", "));
+    }
+};
+
 template<typename T, std::size_t N> requires(N >= 1)
 class ngram_window_tmpl {
     std::array<T, N> grams;
@@ -167,11 +380,19 @@ public:
         return grams[i];
     }
 
+    const T& back() const {
+        DEBUG_ASSERT(cursor != 0);
+        return grams[cursor - 1];
+    }
+
     template<std::size_t W>
     std::optional<ngram_tmpl<T, W>> subview() const {
         DEBUG_ASSERT(W != 0);
         if(W > cursor) {
             return std::nullopt;
+        } else if constexpr(W == 1) {
+            // fast path, skips the span machinery
+            return ngram_tmpl<T, 1>(back());
         } else {
             return std::span(end() - W, end());
         }
@@ -201,6 +422,9 @@ struct std::hash<ngram_window_tmpl<T, N>> {
     }
 };
 
-using ngram_window = ngram_window_tmpl<std::string_view, ngram_max_width>;
+template<std::size_t N = ngram_max_width>
+using ngram_window_n = ngram_window_tmpl<std::string_view, N>;
+
+using ngram_window = ngram_window_n<>;
 
 #endif
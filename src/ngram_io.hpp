@@ -0,0 +1,132 @@
+#ifndef NGRAM_IO_HPP
+#define NGRAM_IO_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <queue>
+#include <span>
+#include <vector>
+
+#include "ngram.hpp"
+#include "utils/serialization.hpp"
+
+template<typename G>
+void write_ngram(binary_writer& writer, const G& ngram) {
+    for(const auto& part : ngram) {
+        writer.write(std::string_view(part));
+    }
+}
+
+template<std::size_t N>
+ngram_view<N> read_ngram(binary_reader& reader) {
+    std::array<std::string_view, N> parts;
+    for(auto& part : parts) {
+        part = reader.read_string();
+    }
+    return std::span<std::string_view>(parts);
+}
+
+template<typename A, typename B>
+bool ngram_less(const A& a, const B& b) {
+    return std::ranges::lexicographical_compare(a, b, [](std::string_view x, std::string_view y) { return x < y; });
+}
+
+// A run is a file of (ngram, count) records sorted by ngram, used to spill first-pass counts to disk
+template<std::size_t N>
+void write_run(const std::filesystem::path& path, const ngram_map<N, std::uint32_t>& map) {
+    std::vector<const typename ngram_map<N, std::uint32_t>::value_type*> entries;
+    entries.reserve(map.size());
+    for(const auto& entry : map) {
+        entries.push_back(&entry);
+    }
+    std::ranges::sort(entries, [](const auto* a, const auto* b) { return ngram_less(a->first, b->first); });
+    binary_writer writer(path);
+    writer.write(std::uint64_t(entries.size()));
+    for(const auto* entry : entries) {
+        write_ngram(writer, entry->first);
+        writer.write(entry->second);
+    }
+    writer.close();
+}
+
+template<std::size_t N>
+class run_reader {
+    mapped_file file;
+    binary_reader reader;
+    std::uint64_t remaining;
+    ngram_view<N> current;
+    std::uint32_t current_count = 0;
+
+public:
+    run_reader(const std::filesystem::path& path)
+        : file(path), reader(file.contents()), remaining(reader.read<std::uint64_t>()) {}
+
+    // advances to the next record, returns false once the run is exhausted
+    bool next() {
+        if(remaining == 0) {
+            return false;
+        }
+        remaining--;
+        current = read_ngram<N>(reader);
+        current_count = reader.read<std::uint32_t>();
+        return true;
+    }
+
+    const ngram_view<N>& key() const {
+        return current;
+    }
+
+    std::uint32_t count() const {
+        return current_count;
+    }
+};
+
+// k-way merge of sorted readers, anything with next() and key(). Invokes the callback once per distinct ngram, in
+// sorted order, with the readers currently positioned on it.
+template<typename R, typename C>
+void merge_sorted(std::span<R* const> readers, const C& callback) {
+    auto greater = [](const R* a, const R* b) { return ngram_less(b->key(), a->key()); };
+    std::priority_queue<R*, std::vector<R*>, decltype(greater)> heap(greater);
+    for(auto* reader : readers) {
+        if(reader->next()) {
+            heap.push(reader);
+        }
+    }
+    std::vector<R*> matching;
+    while(!heap.empty()) {
+        auto key = heap.top()->key();
+        matching.clear();
+        while(!heap.empty() && heap.top()->key() == key) {
+            matching.push_back(heap.top());
+            heap.pop();
+        }
+        callback(key, std::span<R* const>(matching));
+        for(auto* reader : matching) {
+            if(reader->next()) {
+                heap.push(reader);
+            }
+        }
+    }
+}
+
+// k-way merge of sorted runs, invoking the callback once per distinct ngram with its summed count, in sorted order
+template<std::size_t N, typename C>
+void merge_runs(std::span<const std::filesystem::path> paths, const C& callback) {
+    std::vector<std::unique_ptr<run_reader<N>>> runs;
+    std::vector<run_reader<N>*> readers;
+    for(const auto& path : paths) {
+        runs.push_back(std::make_unique<run_reader<N>>(path));
+        readers.push_back(runs.back().get());
+    }
+    merge_sorted<run_reader<N>>(readers, [&](const ngram_view<N>& key, std::span<run_reader<N>* const> matching) {
+        std::uint64_t total = 0;
+        for(const auto* run : matching) {
+            total += run->count();
+        }
+        callback(key, total);
+    });
+}
+
+#endif
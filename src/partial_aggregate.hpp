@@ -0,0 +1,243 @@
+#ifndef PARTIAL_AGGREGATE_HPP
+#define PARTIAL_AGGREGATE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "constants.hpp"
+#include "ngram.hpp"
+#include "ngram_io.hpp"
+#include "utils.hpp"
+#include "utils/serialization.hpp"
+
+// A worker's exact counts for one timestamp range, written by Aggregator::run_partial and combined by
+// Aggregator::merge_partials. Nothing is thresholded or noised, any ngram may still survive once the ranges are
+// combined. Layout: a header, then one section per count set and width of records sorted by ngram, then an index of
+// the sections and the index's offset. A record is the ngram, its total over the range, and its nonzero counts per
+// month in month order.
+
+struct month_count {
+    std::int32_t month; // months since the aggregation epoch
+    std::uint32_t count;
+
+    bool operator==(const month_count&) const = default;
+};
+
+class partial_aggregate_writer {
+    binary_writer writer;
+    struct section {
+        std::uint64_t offset;
+        std::uint64_t records;
+    };
+    std::vector<section> sections;
+
+public:
+    static constexpr std::uint64_t magic = 0x545241504d415247; // "GRAMPART"
+    static constexpr std::uint32_t version = 1;
+
+    partial_aggregate_writer(const std::filesystem::path& path, bool case_folded, sys_ms from, sys_ms to)
+        : writer(path) {
+        writer.write(magic);
+        writer.write(version);
+        writer.write(std::uint32_t(ngram_max_width));
+        writer.write(case_folded);
+        writer.write(std::int64_t(from.time_since_epoch().count()));
+        writer.write(std::int64_t(to.time_since_epoch().count()));
+    }
+
+    // sections have to be written in order, count sets outermost then widths
+    void begin_section() {
+        sections.push_back({writer.position(), 0});
+    }
+
+    template<typename G>
+    void write_record(const G& ngram, std::uint64_t total, std::span<const month_count> months) {
+        write_ngram(writer, ngram);
+        writer.write_varint(total);
+        writer.write_varint(months.size());
+        for(const auto& [month, count] : months) {
+            writer.write(month);
+            writer.write_varint(count);
+        }
+        sections.back().records++;
+    }
+
+    void close() {
+        auto index_offset = writer.position();
+        writer.write(std::uint64_t(sections.size()));
+        for(const auto& [offset, records] : sections) {
+            writer.write(offset);
+            writer.write(records);
+        }
+        writer.write(index_offset);
+        writer.close();
+    }
+};
+
+class partial_aggregate {
+    mapped_file file;
+    bool folded = false;
+    sys_ms range_start;
+    sys_ms range_end;
+    std::vector<std::string_view> sections;
+    std::vector<std::uint64_t> record_counts;
+
+public:
+    partial_aggregate(const std::filesystem::path& path) : file(path) {
+        auto contents = file.contents();
+        binary_reader header(contents);
+        if(
+            header.read<std::uint64_t>() != partial_aggregate_writer::magic
+            || header.read<std::uint32_t>() != partial_aggregate_writer::version
+            || header.read<std::uint32_t>() != ngram_max_width
+        ) {
+            throw std::runtime_error(fmt::format("{} is not a partial aggregate from this build", path.string()));
+        }
+        folded = header.read<bool>();
+        range_start = sys_ms(std::chrono::milliseconds(header.read<std::int64_t>()));
+        range_end = sys_ms(std::chrono::milliseconds(header.read<std::int64_t>()));
+        if(contents.size() < sizeof(std::uint64_t)) {
+            throw std::runtime_error(fmt::format("{} is truncated", path.string()));
+        }
+        auto index_offset = binary_reader(contents.substr(contents.size() - sizeof(std::uint64_t)))
+            .read<std::uint64_t>();
+        if(index_offset > contents.size()) {
+            throw std::runtime_error(fmt::format("{} is truncated", path.string()));
+        }
+        binary_reader index(contents.substr(index_offset));
+        auto count = index.read<std::uint64_t>();
+        if(count != ngram_max_width * (folded ? 2 : 1)) {
+            throw std::runtime_error(fmt::format("{} has an unexpected number of sections", path.string()));
+        }
+        std::vector<std::uint64_t> offsets;
+        for(std::uint64_t i = 0; i < count; i++) {
+            offsets.push_back(index.read<std::uint64_t>());
+            record_counts.push_back(index.read<std::uint64_t>());
+        }
+        offsets.push_back(index_offset);
+        for(std::uint64_t i = 0; i < count; i++) {
+            sections.push_back(contents.substr(offsets[i], offsets[i + 1] - offsets[i]));
+        }
+    }
+
+    bool case_folded() const {
+        return folded;
+    }
+
+    sys_ms from() const {
+        return range_start;
+    }
+
+    sys_ms to() const {
+        return range_end;
+    }
+
+    // the records of one count set (0 exact, 1 case folded) and width
+    std::string_view section(std::size_t set, std::size_t width) const {
+        return sections[set * ngram_max_width + width - 1];
+    }
+
+    std::uint64_t records(std::size_t set, std::size_t width) const {
+        return record_counts[set * ngram_max_width + width - 1];
+    }
+};
+
+// Cursor over one section of a partial aggregate, for merge_sorted
+template<std::size_t N>
+class partial_reader {
+    binary_reader reader;
+    std::uint64_t remaining;
+    ngram_view<N> current;
+    std::uint64_t current_total = 0;
+    std::vector<month_count> current_months;
+
+public:
+    partial_reader(const partial_aggregate& partial, std::size_t set)
+        : reader(partial.section(set, N)), remaining(partial.records(set, N)) {}
+
+    bool next() {
+        if(remaining == 0) {
+            return false;
+        }
+        remaining--;
+        current = read_ngram<N>(reader);
+        current_total = reader.read_varint();
+        current_months.resize(reader.read_varint());
+        for(auto& [month, count] : current_months) {
+            month = reader.read<std::int32_t>();
+            count = std::uint32_t(reader.read_varint());
+        }
+        return true;
+    }
+
+    const ngram_view<N>& key() const {
+        return current;
+    }
+
+    std::uint64_t total() const {
+        return current_total;
+    }
+
+    std::span<const month_count> months() const {
+        return current_months;
+    }
+};
+
+// A worker's sorted run of one month's counts
+template<std::size_t N>
+class month_run_reader : public run_reader<N> {
+    std::int32_t run_month;
+
+public:
+    month_run_reader(const std::filesystem::path& path, std::int32_t month) : run_reader<N>(path), run_month(month) {}
+
+    std::int32_t month() const {
+        return run_month;
+    }
+};
+
+// k-way merge of one section of several partial aggregates, invoking the callback once per distinct ngram with its
+// combined total and monthly counts, in sorted order
+template<std::size_t N, typename C>
+void merge_partial_aggregates(std::span<const partial_aggregate* const> partials, std::size_t set, const C& callback) {
+    std::vector<partial_reader<N>> readers;
+    readers.reserve(partials.size());
+    std::vector<partial_reader<N>*> pointers;
+    for(const auto* partial : partials) {
+        pointers.push_back(&readers.emplace_back(*partial, set));
+    }
+    std::vector<month_count> months;
+    merge_sorted<partial_reader<N>>(
+        pointers,
+        [&](const ngram_view<N>& key, std::span<partial_reader<N>* const> matching) {
+            std::uint64_t total = 0;
+            months.clear();
+            for(const auto* reader : matching) {
+                total += reader->total();
+                months.insert(months.end(), reader->months().begin(), reader->months().end());
+            }
+            std::ranges::sort(months, {}, &month_count::month);
+            // a month split between two ranges has counts in both
+            std::size_t out = 0;
+            for(std::size_t i = 0; i < months.size(); i++) {
+                if(out != 0 && months[out - 1].month == months[i].month) {
+                    months[out - 1].count += months[i].count;
+                } else {
+                    months[out++] = months[i];
+                }
+            }
+            months.resize(out);
+            callback(key, total, std::span<const month_count>(months));
+        }
+    );
+}
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef TOKENIZATION_HPP
 #define TOKENIZATION_HPP
 
+#include <array>
+#include <cstdint>
+#include <string_view>
+
 #include "ngram.hpp"
 
 constexpr std::string_view before_gram_delimiters = " \t\n\r\v!\"#$%&()*,./:;<=>?@[\\]^`{|}~'-+";
@@ -9,33 +13,72 @@ constexpr std::string_view not_at_end = "'-";
 
 constexpr std::size_t snowflake_max_length = 19;
 constexpr std::size_t snowflake_min_length = 17;
-inline bool looks_like_snowflake(std::string_view str) {
-    if(str.size() >= snowflake_min_length && str.size() <= snowflake_max_length) {
-        return std::ranges::all_of(str, [](char c){ return isdigit(c); });
-    } else {
-        return false;
+// Character classes used by the tokenizer, one table lookup per byte
+namespace char_class {
+    constexpr std::uint8_t before_delimiter = 1;
+    constexpr std::uint8_t end_delimiter = 2;
+    constexpr std::uint8_t not_at_end = 4;
+    constexpr std::uint8_t digit = 8;
+
+    constexpr std::array<std::uint8_t, 256> table = [] {
+        std::array<std::uint8_t, 256> table{};
+        auto mark = [&](std::string_view chars, std::uint8_t bit) {
+            for(char c : chars) {
+                table[static_cast<unsigned char>(c)] |= bit;
+            }
+        };
+        mark(before_gram_delimiters, before_delimiter);
+        mark(end_of_gram_delimiters, end_delimiter);
+        mark(::not_at_end, not_at_end);
+        mark("0123456789", digit);
+        return table;
+    }();
+
+    constexpr std::uint8_t of(char c) {
+        return table[static_cast<unsigned char>(c)];
     }
 }
 
-template<typename C>
+// Invokes the callback with a window of up to W of the most recent grams after each gram. W = 1 is a cheap way to
+// just get unigrams.
+template<std::size_t W = ngram_max_width, typename C>
 void tokenize(std::string_view str, const C& callback) {
     std::size_t cursor = 0;
-    ngram_window container;
+    ngram_window_n<W> container;
     while(cursor < str.size()) {
-        auto start = str.find_first_not_of(before_gram_delimiters, cursor);
-        auto end = std::min(str.find_first_of(end_of_gram_delimiters, start), str.size());
-        if(start == std::string_view::npos) {
+        while(cursor < str.size() && char_class::of(str[cursor]) & char_class::before_delimiter) {
+            cursor++;
+        }
+        if(cursor == str.size()) {
             break;
         }
-        cursor = end;
-        auto gram = str.substr(start, end - start);
-        // trim ' and - from the end
-        auto end_pos = gram.find_last_not_of(not_at_end);
-        if(end_pos == std::string_view::npos) { // if the gram is only ' and -, then trimmed would be blank
+        auto start = cursor;
+        // snowflake detection rides along with the scan: track the length of the leading run of digits and the end
+        // of the gram once trailing ' and - are trimmed
+        std::size_t digits = 0;
+        std::size_t trimmed_end = start;
+        bool leading_digits = true;
+        while(cursor < str.size()) {
+            auto cls = char_class::of(str[cursor]);
+            if(cls & char_class::end_delimiter) {
+                break;
+            }
+            leading_digits = leading_digits && (cls & char_class::digit);
+            digits += leading_digits;
+            cursor++;
+            if(!(cls & char_class::not_at_end)) {
+                trimmed_end = cursor;
+            }
+        }
+        if(trimmed_end == start) { // if the gram is only ' and -, then trimmed would be blank
             continue;
         }
-        gram.remove_suffix(gram.size() - end_pos - 1);
-        if(looks_like_snowflake(gram)) {
+        auto gram = str.substr(start, trimmed_end - start);
+        if(
+            digits == gram.size()
+            && gram.size() >= snowflake_min_length
+            && gram.size() <= snowflake_max_length
+        ) {
             container.clear();
             continue;
         }
@@ -1,8 +1,16 @@
 #ifndef UTILS_HPP
 #define UTILS_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <optional>
 #include <string_view>
 #include <chrono>
+#include <thread>
+#include <vector>
 
 #include <ankerl/unordered_dense.h>
 #include <libassert/assert.hpp>
@@ -47,6 +55,49 @@ inline void hash_combine(std::size_t& seed, const T& v) {
     seed ^= hasher(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
 }
 
+// Parses a discord snowflake, which are stored as decimal strings
+constexpr std::optional<std::uint64_t> parse_snowflake(std::string_view str) {
+    if(str.empty() || str.size() > 20) {
+        return std::nullopt;
+    }
+    std::uint64_t value = 0;
+    for(char c : str) {
+        if(c < '0' || c > '9') {
+            return std::nullopt;
+        }
+        auto digit = std::uint64_t(c - '0');
+        if(value > (std::numeric_limits<std::uint64_t>::max() - digit) / 10) {
+            return std::nullopt;
+        }
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+// Fixed set of snowflakes, compiled from their string forms. These sets are small so a sorted array of integers
+// beats hashing strings.
+template<std::size_t N>
+class snowflake_set {
+    std::array<std::uint64_t, N> ids{};
+
+public:
+    consteval snowflake_set(const std::array<std::string_view, N>& strings) {
+        for(std::size_t i = 0; i < N; i++) {
+            ids[i] = parse_snowflake(strings[i]).value();
+        }
+        std::ranges::sort(ids);
+    }
+
+    constexpr bool contains(std::uint64_t id) const {
+        return std::ranges::binary_search(ids, id);
+    }
+
+    constexpr bool contains(std::string_view str) const {
+        auto id = parse_snowflake(str);
+        return id && contains(*id);
+    }
+};
+
 template<std::size_t N>
 constexpr void indexinator(auto&& f) {
     [&]<std::size_t... I>(std::index_sequence<I...>) {
@@ -54,4 +105,21 @@ constexpr void indexinator(auto&& f) {
     }(std::make_index_sequence<N>{});
 }
 
+// Calls f(i) for every i in [0, count) across all hardware threads, returns once all calls have finished
+template<typename F>
+void parallel_for(std::size_t count, const F& f) {
+    std::atomic<std::size_t> next = 0;
+    auto worker = [&] {
+        for(std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+            f(i);
+        }
+    };
+    auto thread_count = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), count);
+    std::vector<std::jthread> threads;
+    for(std::size_t i = 1; i < thread_count; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+}
+
 #endif
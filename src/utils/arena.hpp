@@ -0,0 +1,58 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Append-only arena for small immutable allocations, everything is released at once by reset()
+class monotonic_arena {
+    static constexpr std::size_t block_size = 1024 * 1024;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::size_t block_used = 0;
+    std::size_t block_capacity = 0;
+    std::size_t reserved = 0;
+
+public:
+    char* allocate(std::size_t size) {
+        std::unique_lock lock(mutex);
+        if(block_used + size > block_capacity) {
+            block_capacity = std::max(block_size, size);
+            blocks.push_back(std::make_unique_for_overwrite<char[]>(block_capacity));
+            block_used = 0;
+            reserved += block_capacity;
+        }
+        char* pointer = blocks.back().get() + block_used;
+        block_used += size;
+        return pointer;
+    }
+
+    void reset() {
+        std::unique_lock lock(mutex);
+        blocks.clear();
+        block_used = 0;
+        block_capacity = 0;
+        reserved = 0;
+    }
+
+    // exchanges the allocations of the two arenas, used to replace an arena by a compacted copy
+    void swap(monotonic_arena& other) {
+        std::scoped_lock lock(mutex, other.mutex);
+        blocks.swap(other.blocks);
+        std::swap(block_used, other.block_used);
+        std::swap(block_capacity, other.block_capacity);
+        std::swap(reserved, other.reserved);
+    }
+
+    // bytes reserved from the system
+    std::size_t capacity() {
+        std::unique_lock lock(mutex);
+        return reserved;
+    }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef BLOCKED_BLOOM_FILTER_HPP
+#define BLOCKED_BLOOM_FILTER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <ankerl/unordered_dense.h>
+#include <libassert/assert.hpp>
+
+// Bloom filter where all of a key's bits fall in one 64-byte block, so a query touches a single cache line. Keys are
+// given as 64-bit hashes, which should already be well mixed.
+class blocked_bloom_filter {
+    struct alignas(64) block {
+        std::uint64_t words[8];
+    };
+    std::vector<block> blocks;
+    unsigned hash_count = 0;
+
+    std::size_t block_of(std::uint64_t hash) const {
+        return std::size_t((static_cast<unsigned __int128>(hash) * blocks.size()) >> 64);
+    }
+
+    // Bit positions within the block are 9-bit slices of a remix of the hash, the block used the high bits. Double
+    // hashing would be cheaper but its arithmetic progressions overlap too often within 512 bits.
+    template<typename C>
+    void for_each_bit(std::uint64_t hash, const C& callback) const {
+        auto bits = ankerl::unordered_dense::detail::wyhash::hash(hash);
+        for(unsigned i = 0, left = 7; i < hash_count; i++, left--) {
+            if(left == 0) {
+                bits = ankerl::unordered_dense::detail::wyhash::hash(bits);
+                left = 7;
+            }
+            auto bit = bits & 511;
+            bits >>= 9;
+            callback(bit / 64, std::uint64_t(1) << (bit % 64));
+        }
+    }
+
+public:
+    blocked_bloom_filter() = default;
+
+    // Keys per block are Poisson distributed and the fuller blocks dominate the false positive rate, more so the lower
+    // the target rate
+    static double expected_false_positive_rate(double keys_per_block, unsigned hashes) {
+        double rate = 0;
+        double probability = std::exp(-keys_per_block);
+        for(unsigned keys = 0; keys < keys_per_block * 4 + 64; keys++) {
+            if(keys != 0) {
+                probability *= keys_per_block / keys;
+            }
+            rate += probability * std::pow(1 - std::pow(1 - 1.0 / 512, double(hashes * keys)), hashes);
+        }
+        return rate;
+    }
+
+    // Sized for the given number of keys and target false positive rate, starting from what an unblocked filter would
+    // need and growing until the blocked filter's expected rate meets the target. The estimate runs a little low in
+    // practice, hence the margin.
+    blocked_bloom_filter(std::size_t keys, double false_positive_rate) {
+        // anything else never meets the target or sizes the filter from a negative bits per key
+        ASSERT(false_positive_rate > 0 && false_positive_rate < 1);
+        double bits_per_key = -std::log(false_positive_rate) / (std::log(2.0) * std::log(2.0));
+        while(true) {
+            hash_count = unsigned(std::clamp(std::lround(bits_per_key * std::log(2.0)), 1L, 16L));
+            if(expected_false_positive_rate(512 / bits_per_key, hash_count) <= false_positive_rate * 0.8) {
+                break;
+            }
+            bits_per_key *= 1.05;
+        }
+        blocks.resize(std::max<std::size_t>(1, std::size_t(double(keys) * bits_per_key / 512) + 1));
+    }
+
+    bool enabled() const {
+        return !blocks.empty();
+    }
+
+    void insert(std::uint64_t hash) {
+        auto& target = blocks[block_of(hash)];
+        for_each_bit(hash, [&](std::size_t word, std::uint64_t mask) { target.words[word] |= mask; });
+    }
+
+    void prefetch(std::uint64_t hash) const {
+        if(!blocks.empty()) {
+            __builtin_prefetch(&blocks[block_of(hash)]);
+        }
+    }
+
+    // false means definitely absent, a disabled filter contains everything
+    bool may_contain(std::uint64_t hash) const {
+        if(blocks.empty()) {
+            return true;
+        }
+        const auto& target = blocks[block_of(hash)];
+        bool present = true;
+        for_each_bit(hash, [&](std::size_t word, std::uint64_t mask) { present &= (target.words[word] & mask) != 0; });
+        return present;
+    }
+
+    std::size_t bytes() const {
+        return blocks.size() * sizeof(block);
+    }
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef CASE_FOLDING_HPP
+#define CASE_FOLDING_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "case_folding_table.hpp"
+
+// Simple (one to one) unicode lowercasing, generated from the Unicode character database so that it agrees with
+// javascript's toLowerCase() plus the fixups in the server's fold_case(), which is what the server does to queries.
+// Invalid UTF-8 (stray continuation bytes, truncated or overlong sequences, surrogates and anything past U+10FFFF) is
+// passed through unchanged byte by byte.
+
+namespace detail {
+    constexpr char32_t fold_codepoint(char32_t c) {
+        if(c >= 'A' && c <= 'Z') {
+            return c + 32;
+        }
+        if(c < 0xc0) {
+            return c;
+        }
+        auto it = std::ranges::upper_bound(fold_ranges, c, {}, &fold_range::first);
+        if(it == fold_ranges.begin()) {
+            return c;
+        }
+        const auto& range = *--it;
+        if(c > range.last || (c - range.first) % range.stride != 0) {
+            return c;
+        }
+        return char32_t(std::int32_t(c) + range.delta);
+    }
+
+    inline void append_utf8(std::string& out, char32_t c) {
+        if(c < 0x80) {
+            out += char(c);
+        } else if(c < 0x800) {
+            out += char(0xc0 | (c >> 6));
+            out += char(0x80 | (c & 0x3f));
+        } else if(c < 0x10000) {
+            out += char(0xe0 | (c >> 12));
+            out += char(0x80 | ((c >> 6) & 0x3f));
+            out += char(0x80 | (c & 0x3f));
+        } else {
+            out += char(0xf0 | (c >> 18));
+            out += char(0x80 | ((c >> 12) & 0x3f));
+            out += char(0x80 | ((c >> 6) & 0x3f));
+            out += char(0x80 | (c & 0x3f));
+        }
+    }
+}
+
+// Appends the case folded form of str to out
+inline void fold_case(std::string_view str, std::string& out) {
+    out.reserve(out.size() + str.size());
+    std::size_t i = 0;
+    while(i < str.size()) {
+        auto byte = static_cast<unsigned char>(str[i]);
+        if(byte < 0x80) {
+            out += byte >= 'A' && byte <= 'Z' ? char(byte + 32) : char(byte);
+            i++;
+            continue;
+        }
+        std::size_t length = byte > 0xf4 ? 0 : byte >= 0xf0 ? 4 : byte >= 0xe0 ? 3 : byte >= 0xc0 ? 2 : 0;
+        char32_t c = length == 4 ? byte & 0x07 : length == 3 ? byte & 0x0f : byte & 0x1f;
+        bool valid = length != 0 && i + length <= str.size();
+        for(std::size_t j = 1; valid && j < length; j++) {
+            auto continuation = static_cast<unsigned char>(str[i + j]);
+            valid = (continuation & 0xc0) == 0x80;
+            c = (c << 6) | (continuation & 0x3f);
+        }
+        // overlong encodings, surrogates and codepoints past the end of unicode
+        constexpr char32_t shortest[] = {0, 0, 0x80, 0x800, 0x10000};
+        valid = valid && c >= shortest[length] && c <= 0x10ffff && (c < 0xd800 || c > 0xdfff);
+        if(!valid) {
+            out += str[i];
+            i++;
+            continue;
+        }
+        if(c == 0x130) {
+            // javascript lowercases a dotted capital I to i followed by a combining dot
+            out += "i\xcc\x87";
+        } else {
+            detail::append_utf8(out, detail::fold_codepoint(c));
+        }
+        i += length;
+    }
+}
+
+inline std::string fold_case(std::string_view str) {
+    std::string out;
+    fold_case(str, out);
+    return out;
+}
+
+#endif
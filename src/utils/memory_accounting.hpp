@@ -0,0 +1,66 @@
+#ifndef MEMORY_ACCOUNTING_HPP
+#define MEMORY_ACCOUNTING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+// Running total of the bytes held through every allocator sharing an account, plus the high water mark
+class memory_account {
+    std::atomic<std::size_t> current{0};
+    std::atomic<std::size_t> high_water{0};
+
+public:
+    void allocated(std::size_t size) {
+        auto now = current.fetch_add(size, std::memory_order_relaxed) + size;
+        auto peak = high_water.load(std::memory_order_relaxed);
+        while(now > peak && !high_water.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+    }
+
+    void deallocated(std::size_t size) {
+        current.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    std::size_t bytes() const {
+        return current.load(std::memory_order_relaxed);
+    }
+
+    std::size_t peak() const {
+        return high_water.load(std::memory_order_relaxed);
+    }
+};
+
+// Stateless allocator charging everything to Account::account(), so that containers keep their default
+// construction and accounting is per container type rather than per instance
+template<typename T, typename Account>
+class accounted_allocator {
+public:
+    using value_type = T;
+
+    template<typename U>
+    struct rebind {
+        using other = accounted_allocator<U, Account>;
+    };
+
+    accounted_allocator() = default;
+
+    template<typename U>
+    accounted_allocator(const accounted_allocator<U, Account>&) {}
+
+    T* allocate(std::size_t n) {
+        Account::account().allocated(n * sizeof(T));
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T* pointer, std::size_t n) {
+        Account::account().deallocated(n * sizeof(T));
+        ::operator delete(pointer, n * sizeof(T), std::align_val_t(alignof(T)));
+    }
+
+    template<typename U>
+    bool operator==(const accounted_allocator<U, Account>&) const {
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef MESSAGE_CACHE_HPP
+#define MESSAGE_CACHE_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ankerl/unordered_dense.h>
+
+// Direct mapped cache from short message bodies to whatever counting them resolved to, so that repeats of common
+// messages ("lol", "thanks", copypasta) skip tokenization and lookups. Only short messages are cached, long ones
+// rarely repeat and would crowd out the ones that do.
+template<typename T>
+class message_cache {
+public:
+    static constexpr std::size_t max_length = 128;
+
+private:
+    struct slot {
+        std::uint64_t hash = 0;
+        bool used = false;
+        std::string content;
+        std::vector<T> values;
+    };
+    std::vector<slot> slots;
+    std::uint64_t hit_count = 0;
+    std::uint64_t miss_count = 0;
+
+    slot& slot_for(std::uint64_t hash) {
+        return slots[hash & (slots.size() - 1)];
+    }
+
+public:
+    message_cache() = default;
+
+    explicit message_cache(std::size_t size) : slots(size == 0 ? 0 : std::bit_ceil(size)) {}
+
+    bool eligible(std::string_view content) const {
+        return !slots.empty() && content.size() <= max_length;
+    }
+
+    static std::uint64_t hash(std::string_view content) {
+        return ankerl::unordered_dense::hash<std::string_view>{}(content);
+    }
+
+    // The cached values for an eligible message, or nullptr
+    const std::vector<T>* find(std::string_view content, std::uint64_t hash) {
+        auto& entry = slot_for(hash);
+        if(entry.used && entry.hash == hash && entry.content == content) {
+            hit_count++;
+            return &entry.values;
+        }
+        miss_count++;
+        return nullptr;
+    }
+
+    // Replaces whatever was cached in the message's slot, the caller fills in the values
+    std::vector<T>& insert(std::string_view content, std::uint64_t hash) {
+        auto& entry = slot_for(hash);
+        entry.hash = hash;
+        entry.used = true;
+        entry.content = content;
+        entry.values.clear();
+        return entry.values;
+    }
+
+    std::uint64_t hits() const {
+        return hit_count;
+    }
+
+    std::uint64_t misses() const {
+        return miss_count;
+    }
+};
+
+#endif
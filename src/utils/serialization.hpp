@@ -0,0 +1,196 @@
+#ifndef SERIALIZATION_HPP
+#define SERIALIZATION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+// Simple buffered writer for compact binary files (checkpoints and the like). Values are written in native byte order,
+// these files are only meant to be read back on the same machine.
+class binary_writer {
+    std::FILE* file;
+    std::vector<char> buffer;
+    std::uint64_t written = 0;
+    static constexpr std::size_t buffer_size = 1024 * 1024;
+
+public:
+    binary_writer(const std::filesystem::path& path) : file(std::fopen(path.c_str(), "wb")) {
+        if(!file) {
+            throw std::runtime_error(fmt::format("Unable to open {} for writing", path.string()));
+        }
+        buffer.reserve(buffer_size);
+    }
+
+    ~binary_writer() {
+        if(file) {
+            std::fclose(file);
+        }
+    }
+
+    binary_writer(const binary_writer&) = delete;
+    binary_writer& operator=(const binary_writer&) = delete;
+
+    void write_bytes(const void* data, std::size_t size) {
+        written += size;
+        if(buffer.size() + size > buffer_size) {
+            flush();
+        }
+        if(size > buffer_size) {
+            write_through(data, size);
+        } else {
+            buffer.insert(buffer.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+        }
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    void write(const T& value) {
+        write_bytes(&value, sizeof(value));
+    }
+
+    void write_varint(std::uint64_t value) {
+        char bytes[10];
+        std::size_t i = 0;
+        while(value >= 0x80) {
+            bytes[i++] = char(value | 0x80);
+            value >>= 7;
+        }
+        bytes[i++] = char(value);
+        write_bytes(bytes, i);
+    }
+
+    void write(std::string_view str) {
+        write_varint(str.size());
+        write_bytes(str.data(), str.size());
+    }
+
+    // bytes written so far, buffered or not
+    std::uint64_t position() const {
+        return written;
+    }
+
+    void flush() {
+        write_through(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    // flushes and closes the file, reporting any errors
+    void close() {
+        flush();
+        if(std::fflush(file) != 0 || fsync(fileno(file)) != 0 || std::fclose(file) != 0) {
+            file = nullptr;
+            throw std::runtime_error("Error while closing binary file");
+        }
+        file = nullptr;
+    }
+
+private:
+    void write_through(const void* data, std::size_t size) {
+        if(size != 0 && std::fwrite(data, 1, size, file) != size) {
+            throw std::runtime_error("Error while writing binary file");
+        }
+    }
+};
+
+// Read-only memory mapping of a whole file
+class mapped_file {
+    const char* data = nullptr;
+    std::size_t size = 0;
+
+public:
+    mapped_file(const std::filesystem::path& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd == -1) {
+            throw std::runtime_error(fmt::format("Unable to open {} for reading", path.string()));
+        }
+        struct stat info;
+        if(fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("Unable to stat {}", path.string()));
+        }
+        size = std::size_t(info.st_size);
+        if(size != 0) {
+            void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapping == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error(fmt::format("Unable to map {}", path.string()));
+            }
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(mapping);
+        }
+        ::close(fd);
+    }
+
+    ~mapped_file() {
+        if(data) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    std::string_view contents() const {
+        return {data, size};
+    }
+};
+
+// Cursor over a binary buffer produced by binary_writer
+class binary_reader {
+    std::string_view data;
+    std::size_t cursor = 0;
+
+public:
+    binary_reader(std::string_view data) : data(data) {}
+
+    std::string_view read_bytes(std::size_t size) {
+        if(size > data.size() - cursor) {
+            throw std::runtime_error("Unexpected end of binary file");
+        }
+        auto bytes = data.substr(cursor, size);
+        cursor += size;
+        return bytes;
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    T read() {
+        T value;
+        std::memcpy(&value, read_bytes(sizeof(T)).data(), sizeof(T));
+        return value;
+    }
+
+    std::uint64_t read_varint() {
+        std::uint64_t value = 0;
+        for(unsigned shift = 0; shift < 64; shift += 7) {
+            auto byte = read<std::uint8_t>();
+            value |= std::uint64_t(byte & 0x7f) << shift;
+            if(!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Malformed varint in binary file");
+    }
+
+    std::string_view read_string() {
+        return read_bytes(read_varint());
+    }
+
+    bool done() const {
+        return cursor == data.size();
+    }
+};
+
+#endif
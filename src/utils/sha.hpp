@@ -28,12 +28,14 @@ struct ShaContextManager {
     }
 };
 
-inline ShaContextManager sha_context_manager;
+// one per thread so ngram maps can be set up in parallel
+inline thread_local ShaContextManager sha_context_manager;
 
 using sha256_digest = std::array<unsigned char, 256 / 8>;
 
-template<typename T, size_t N>
-sha256_digest sha256(const ngram_tmpl<T, N>& ngram, std::string_view nonce) {
+// works on any ngram representation (ngram_tmpl or packed_ngram), the digest only depends on the grams
+template<typename G>
+sha256_digest sha256(const G& ngram, std::string_view nonce) {
     sha256_digest dst;
 
     auto* context = sha_context_manager.fresh_context();
@@ -41,7 +43,7 @@ sha256_digest sha256(const ngram_tmpl<T, N>& ngram, std::string_view nonce) {
         EVP_DigestUpdate(context, part.data(), part.size());
     }
     EVP_DigestUpdate(context, nonce.data(), nonce.size());
-    auto n = N;
+    std::size_t n = ngram.size();
     EVP_DigestUpdate(context, &n, sizeof(n));
     EVP_DigestFinal_ex(context, dst.data(), 0);
 
@@ -0,0 +1,60 @@
+#include <string>
+#include <vector>
+
+#include "batched_lookup.hpp"
+#include "frozen_ngram_map.hpp"
+#include "ngram.hpp"
+#include "utils/blocked_bloom_filter.hpp"
+
+#include <libassert/assert-gtest.hpp> // has to come last, not ideal
+
+namespace {
+    std::vector<ngram_probe<1>> make_probes(const std::vector<std::string>& words) {
+        std::vector<ngram_probe<1>> probes;
+        for(const auto& word : words) {
+            ngram_view<1> key{std::string_view(word)};
+            probes.push_back({key, ngram_hash{}(key)});
+        }
+        return probes;
+    }
+}
+
+TEST(BatchedLookup, Stats) {
+    std::vector<std::string> present;
+    std::vector<std::string> absent;
+    for(int i = 0; i < 1000; i++) {
+        present.push_back(fmt::format("present{}", i));
+        absent.push_back(fmt::format("absent{}", i));
+    }
+    std::vector<std::pair<packed_ngram<1>, int>> entries;
+    for(const auto& word : present) {
+        entries.emplace_back(ngram_view<1>{word}, 1);
+    }
+    frozen_ngram_map<1, int> map(std::move(entries));
+    blocked_bloom_filter filter(map.size(), 0.01);
+    for(const auto& [key, value] : map) {
+        filter.insert(ngram_hash{}(key));
+    }
+    lookup_stats stats;
+    int total = 0;
+    auto probes = make_probes(present);
+    batched_lookup(map, filter, probes, stats, [&](int value) { total += value; });
+    probes = make_probes(absent);
+    batched_lookup(map, filter, probes, stats, [&](int value) { total += value; });
+    ASSERT(total == 1000);
+    ASSERT(stats.hits == 1000);
+    ASSERT(stats.rejected + stats.false_positives == 1000);
+    ASSERT(stats.rejected > 900);
+}
+
+TEST(BatchedLookup, EmptyMapRejects) {
+    frozen_ngram_map<1, int> map;
+    blocked_bloom_filter filter;
+    lookup_stats stats;
+    std::vector<std::string> words{"foo", "bar"};
+    auto probes = make_probes(words);
+    batched_lookup(map, filter, probes, stats, [](int) { ASSERT(false); });
+    ASSERT(stats.rejected == 2);
+    ASSERT(stats.false_positives == 0);
+    ASSERT(stats.hits == 0);
+}
@@ -0,0 +1,42 @@
+#include <cstdint>
+#include <vector>
+
+#include <xoshiro-cpp/XoshiroCpp.hpp>
+
+#include "utils/blocked_bloom_filter.hpp"
+
+#include <libassert/assert-gtest.hpp> // has to come last, not ideal
+
+TEST(BloomFilter, NoFalseNegatives) {
+    XoshiroCpp::Xoroshiro128Plus rng(1);
+    blocked_bloom_filter filter(10000, 0.01);
+    std::vector<std::uint64_t> keys;
+    for(int i = 0; i < 10000; i++) {
+        keys.push_back(rng());
+        filter.insert(keys.back());
+    }
+    for(auto key : keys) {
+        ASSERT(filter.may_contain(key));
+    }
+}
+
+TEST(BloomFilter, FalsePositiveRate) {
+    XoshiroCpp::Xoroshiro128Plus rng(2);
+    for(double rate : {0.1, 0.01, 0.001}) {
+        blocked_bloom_filter filter(100000, rate);
+        for(int i = 0; i < 100000; i++) {
+            filter.insert(rng());
+        }
+        int false_positives = 0;
+        for(int i = 0; i < 1000000; i++) {
+            false_positives += filter.may_contain(rng());
+        }
+        ASSERT(double(false_positives) / 1000000 < rate * 1.5, rate, false_positives);
+    }
+}
+
+TEST(BloomFilter, Disabled) {
+    blocked_bloom_filter filter;
+    ASSERT(!filter.enabled());
+    ASSERT(filter.may_contain(42));
+}
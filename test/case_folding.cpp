@@ -0,0 +1,35 @@
+#include <string>
+
+#include "utils/case_folding.hpp"
+
+#include <libassert/assert-gtest.hpp> // has to come last, not ideal
+
+TEST(CaseFolding, Ascii) {
+    ASSERT(fold_case("Hello, World! std::Vector<INT>") == "hello, world! std::vector<int>");
+}
+
+TEST(CaseFolding, Unicode) {
+    ASSERT(fold_case("ÀÉÎÕÜ Ÿ") == "àéîõü ÿ");
+    ASSERT(fold_case("ΣΟΦΊΑ σοφός") == "σοφία σοφόσ");
+    ASSERT(fold_case("ПРИВЕТ Ёж") == "привет ёж");
+    ASSERT(fold_case("ＡＢＣ") == "ａｂｃ");
+    ASSERT(fold_case("İ") == "i\xcc\x87");
+    ASSERT(fold_case("ȘȚƏ Ǆǅ") == "șțə ǆǆ");
+    ASSERT(fold_case("ἈΩ ᲐᲑ ᎠᎡ") == "ἀω აბ ꭰꭱ");
+    ASSERT(fold_case("Ⅻ ⒶⒷ 𐐀") == "ⅻ ⓐⓑ 𐐨");
+    // already folded and uncased text is untouched
+    ASSERT(fold_case("ß 日本語 😀") == "ß 日本語 😀");
+}
+
+TEST(CaseFolding, InvalidUtf8) {
+    ASSERT(fold_case("A\xff" "B\xc3") == "a\xff" "b\xc3");
+    // overlong forms aren't decoded
+    ASSERT(fold_case("\xc0\x80") == "\xc0\x80");
+    ASSERT(fold_case("\xc1\x81") == "\xc1\x81");
+    ASSERT(fold_case("\xe0\x81\x81") == "\xe0\x81\x81");
+    ASSERT(fold_case("\xf0\x80\x81\x81") == "\xf0\x80\x81\x81");
+    // nor is anything past U+10FFFF or a surrogate
+    ASSERT(fold_case("\xf4\x90\x80\x80") == "\xf4\x90\x80\x80");
+    ASSERT(fold_case("\xf8\x88\x80\x80\x80") == "\xf8\x88\x80\x80\x80");
+    ASSERT(fold_case("\xed\xa0\x80") == "\xed\xa0\x80");
+}
@@ -0,0 +1,77 @@
+#include <string>
+#include <vector>
+
+#include "frozen_ngram_map.hpp"
+#include "ngram.hpp"
+
+#include <libassert/assert-gtest.hpp> // has to come last, not ideal
+
+TEST(FrozenNgramMap, Lookup) {
+    std::vector<std::string> words;
+    for(int i = 0; i < 10000; i++) {
+        words.push_back(fmt::format("word{}", i));
+    }
+    // the last one is long enough to go through the overflow arena
+    words.push_back("a gram long enough that it doesn't fit inline in the packed representation");
+    std::vector<std::pair<packed_ngram<2>, int>> entries;
+    for(std::size_t i = 0; i + 1 < words.size(); i += 2) {
+        entries.emplace_back(ngram_view<2>{words[i], words[i + 1]}, int(i));
+    }
+    entries.emplace_back(ngram_view<2>{words[0], words.back()}, -1);
+    auto size = entries.size();
+    frozen_ngram_map<2, int> map(std::move(entries));
+    ASSERT(map.size() == size);
+    for(std::size_t i = 0; i + 1 < words.size(); i += 2) {
+        auto it = map.find(ngram_view<2>{words[i], words[i + 1]});
+        ASSERT(it != map.end());
+        ASSERT(it->second == int(i));
+        it->second++;
+        ASSERT(map.find(ngram_view<2>{words[i], words[i + 1]})->second == int(i) + 1);
+        ASSERT(map.find(ngram_view<2>{words[i + 1], words[i]}) == map.end());
+    }
+    ASSERT(map.find(ngram_view<2>{words[0], words.back()})->second == -1);
+    ASSERT(map.find(ngram_view<2>{"word0"sv, "missing"sv}) == map.end());
+    std::size_t iterated = 0;
+    for(auto& entry : map) {
+        ASSERT(map.find(entry.first) == &entry);
+        iterated++;
+    }
+    ASSERT(iterated == size);
+}
+
+TEST(FrozenNgramMap, Empty) {
+    frozen_ngram_map<1, int> map;
+    ASSERT(map.empty());
+    ASSERT(map.find(ngram_view<1>{"foo"sv}) == map.end());
+    frozen_ngram_map<1, int> built(std::vector<std::pair<packed_ngram<1>, int>>{});
+    ASSERT(built.find(ngram_view<1>{"foo"sv}) == built.end());
+}
+
+TEST(FrozenNgramMap, ConstructionOrder) {
+    std::vector<std::string> words;
+    std::vector<std::pair<packed_ngram<1>, int>> entries;
+    for(int i = 0; i < 1000; i++) {
+        words.push_back(fmt::format("word{}", i));
+    }
+    for(int i = 0; i < 1000; i++) {
+        entries.emplace_back(ngram_view<1>{words[i]}, i);
+    }
+    frozen_ngram_map<1, int> map(std::move(entries));
+    int expected = 0;
+    map.for_each_in_order([&](const auto& entry) {
+        ASSERT(entry.second == expected);
+        ASSERT(*entry.first.begin() == words[expected]);
+        expected++;
+    });
+    ASSERT(expected == 1000);
+}
+
+TEST(FrozenNgramMap, DuplicateHashesThrow) {
+    // equal keys hash the same, which no pilot or seed can separate, this has to fail before any pilot search
+    std::vector<std::pair<packed_ngram<1>, int>> entries;
+    for(int i = 0; i < 100; i++) {
+        entries.emplace_back(ngram_view<1>{fmt::format("word{}", i)}, i);
+    }
+    entries.emplace_back(ngram_view<1>{"word42"sv}, 100);
+    EXPECT_THROW((frozen_ngram_map<1, int>(std::move(entries))), std::runtime_error);
+}
@@ -0,0 +1,110 @@
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.hpp"
+#include "lossy_counts.hpp"
+#include "ngram.hpp"
+
+#include <libassert/assert-gtest.hpp> // has to come last, not ideal
+
+namespace {
+    // ends a bucket the way Aggregator::prune_counts does
+    template<std::size_t N>
+    std::size_t end_bucket(lossy_counts_map<N>& map, std::uint32_t& buckets) {
+        monotonic_arena compacted;
+        auto evicted = prune_lossy_counts(map, ++buckets, compacted);
+        packed_ngram<N>::arena().swap(compacted);
+        return evicted;
+    }
+}
+
+TEST(LossyCounts, LateRareNgramEvicted) {
+    lossy_counts_map<1> map;
+    std::uint32_t buckets = 0;
+    for(int i = 0; i < 100; i++) {
+        add_lossy_count(map, ngram_view<1>{"common"}, buckets);
+        add_lossy_count(map, ngram_view<1>{"common"}, buckets);
+        end_bucket(map, buckets);
+    }
+    // inserted long after the error exceeded the threshold, it still goes at the end of its bucket
+    ASSERT(add_lossy_count(map, ngram_view<1>{"rare"}, buckets));
+    ASSERT(map.find(ngram_view<1>{"rare"})->second.error == 100);
+    ASSERT(end_bucket(map, buckets) == 1);
+    ASSERT(!map.contains(ngram_view<1>{"rare"}));
+    const auto& common = map.find(ngram_view<1>{"common"})->second;
+    ASSERT(common.count == 200);
+    ASSERT(common.error == 0);
+}
+
+TEST(LossyCounts, CountsBoundTrueCounts) {
+    // ngram k > 0 shows up in every (k + 1)th bucket, one in three buckets has a burst of it, ngram 0 is in every
+    // bucket twice
+    constexpr std::size_t ngrams = 64;
+    constexpr std::uint32_t total_buckets = 500;
+    lossy_counts_map<1> map;
+    std::vector<std::string> names;
+    for(std::size_t k = 0; k < ngrams; k++) {
+        names.push_back("ngram " + std::to_string(k));
+    }
+    std::vector<std::uint32_t> truth(ngrams);
+    std::uint32_t buckets = 0;
+    while(buckets < total_buckets) {
+        for(std::size_t k = 0; k < ngrams; k++) {
+            if(buckets % (k + 1) != 0) {
+                continue;
+            }
+            auto occurrences = k == 0 ? 2 : buckets % 3 == 0 ? k % 5 + 1 : 1;
+            for(std::size_t i = 0; i < occurrences; i++) {
+                add_lossy_count(map, ngram_view<1>{names[k]}, buckets);
+                truth[k]++;
+            }
+        }
+        end_bucket(map, buckets);
+    }
+    for(std::size_t k = 0; k < ngrams; k++) {
+        auto it = map.find(ngram_view<1>{names[k]});
+        if(it == map.end()) {
+            // evicted ngrams can't have been seen more than once per bucket
+            ASSERT(truth[k] <= total_buckets);
+            continue;
+        }
+        ASSERT(it->second.count <= truth[k]);
+        ASSERT(truth[k] <= it->second.count + it->second.error);
+        // so thresholding the count never lets an ngram below the threshold through
+        if(it->second.count >= minimum_occurrences) {
+            ASSERT(truth[k] >= minimum_occurrences);
+        }
+    }
+    // seen more than once per bucket, never evicted
+    ASSERT(map.find(ngram_view<1>{names[0]})->second.count == truth[0]);
+}
+
+TEST(LossyCounts, PruningReleasesOverflowedKeys) {
+    // a width no other test keys use, the arena is shared by every key of the width
+    constexpr std::size_t N = 7;
+    lossy_counts_map<N> map;
+    std::uint32_t buckets = 0;
+    std::vector<std::string> grams;
+    for(int i = 0; i < 20000; i++) {
+        grams.push_back(std::string(64, 'a') + std::to_string(i));
+    }
+    std::string long_gram(64, 'b');
+    std::vector<std::string_view> kept_grams(N, long_gram);
+    ngram_view<N> kept = std::span(kept_grams);
+    for(const auto& gram : grams) {
+        std::vector<std::string_view> parts(N, gram);
+        ngram_view<N> view = std::span(parts);
+        add_lossy_count(map, view, buckets);
+    }
+    add_lossy_count(map, kept, buckets);
+    add_lossy_count(map, kept, buckets);
+    auto before = packed_ngram<N>::arena().capacity();
+    ASSERT(before > 1024 * 1024);
+    ASSERT(end_bucket(map, buckets) == grams.size());
+    ASSERT(packed_ngram<N>::arena().capacity() < before);
+    ASSERT(map.size() == 1);
+    ASSERT(map.begin()->first == kept);
+    ASSERT(map.find(kept)->second.count == 2);
+}
@@ -0,0 +1,38 @@
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "utils/message_cache.hpp"
+
+#include <libassert/assert-gtest.hpp> // has to come last, not ideal
+
+TEST(MessageCache, HitsAfterInsert) {
+    message_cache<int> cache(16);
+    auto hash = cache.hash("thanks");
+    ASSERT(cache.find("thanks", hash) == nullptr);
+    cache.insert("thanks", hash) = {1, 2, 3};
+    const auto* values = cache.find("thanks", hash);
+    ASSERT(values != nullptr);
+    const std::vector expected = {1, 2, 3};
+    ASSERT(*values == expected);
+    ASSERT(cache.hits() == 1);
+    ASSERT(cache.misses() == 1);
+}
+
+TEST(MessageCache, ComparesContent) {
+    // a single slot, everything collides
+    message_cache<int> cache(1);
+    cache.insert("lol", cache.hash("lol")).push_back(1);
+    ASSERT(cache.find("lmao", cache.hash("lol")) == nullptr);
+    cache.insert("lmao", cache.hash("lmao")).push_back(2);
+    ASSERT(cache.find("lol", cache.hash("lol")) == nullptr);
+    ASSERT(cache.find("lmao", cache.hash("lmao"))->front() == 2);
+}
+
+TEST(MessageCache, Eligibility) {
+    message_cache<int> disabled;
+    ASSERT(!disabled.eligible("hi"));
+    message_cache<int> cache(16);
+    ASSERT(cache.eligible("hi"));
+    ASSERT(!cache.eligible(std::string(message_cache<int>::max_length + 1, 'x')));
+}
@@ -0,0 +1,35 @@
+#include <filesystem>
+#include <vector>
+
+#include "ngram_io.hpp"
+
+#include <libassert/assert-gtest.hpp>
+
+TEST(NgramIo, MergeRuns) {
+    auto directory = std::filesystem::temp_directory_path();
+    std::vector<std::filesystem::path> runs{directory / "ngrams_test.0.run", directory / "ngrams_test.1.run"};
+    ngram_map<2, std::uint32_t> first;
+    first[ngram<2>{"foo", "bar"}] = 2;
+    first[ngram<2>{"a", "b"}] = 1;
+    first[ngram<2>{"x", "y"}] = 5;
+    write_run<2>(runs[0], first);
+    ngram_map<2, std::uint32_t> second;
+    second[ngram<2>{"foo", "bar"}] = 3;
+    second[ngram<2>{"a", "c"}] = 4;
+    write_run<2>(runs[1], second);
+
+    std::vector<std::pair<ngram<2>, std::uint64_t>> merged;
+    merge_runs<2>(runs, [&](const ngram_view<2>& key, std::uint64_t total) {
+        merged.emplace_back(key, total);
+    });
+    std::vector<std::pair<ngram<2>, std::uint64_t>> expected{
+        {{"a", "b"}, 1},
+        {{"a", "c"}, 4},
+        {{"foo", "bar"}, 5},
+        {{"x", "y"}, 5}
+    };
+    ASSERT(merged == expected);
+    for(const auto& run : runs) {
+        std::filesystem::remove(run);
+    }
+}
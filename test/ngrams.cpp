@@ -82,3 +82,79 @@ TEST(Ngrams, FiveGrams) {
     });
     ASSERT(output == expected);
 }
+
+TEST(Ngrams, PackedInline) {
+    ngram_view<3> view{"foo", "bar", "baz"};
+    packed_ngram<3> packed(view);
+    ASSERT(packed == view);
+    ASSERT(packed == packed_ngram<3>(ngram<3>{"foo", "bar", "baz"}));
+    ASSERT(!(packed == packed_ngram<3>(ngram_view<3>{"foo", "ba", "rbaz"})));
+    ASSERT(packed[0] == "foo");
+    ASSERT(packed[1] == "bar");
+    ASSERT(packed[2] == "baz");
+    ASSERT(ngram_hash{}(packed) == ngram_hash{}(view));
+    ASSERT(ngram_hash{}(packed) == ngram_hash{}(ngram<3>(view)));
+}
+
+TEST(Ngrams, PackedOverflow) {
+    std::string_view long_gram = "a gram long enough that it doesn't fit inline in the packed representation"sv;
+    ngram_view<2> view{"foo"sv, long_gram};
+    packed_ngram<2> packed(view);
+    ASSERT(packed == view);
+    ASSERT(packed == packed_ngram<2>(view));
+    ASSERT(!(packed == packed_ngram<2>(ngram_view<2>{"fo"sv, long_gram})));
+    ASSERT(packed[1] == long_gram);
+    ASSERT(ngram_hash{}(packed) == ngram_hash{}(view));
+    ASSERT(fmt::format("{}", packed) == fmt::format("foo, {}", long_gram));
+}
+
+TEST(Ngrams, PackedWideOverflow) {
+    // wide keys have room for a gram of 255 bytes or more inline, which a length byte can't hold
+    for(std::size_t length : {255, 256}) {
+        std::string long_gram(length, 'a');
+        std::vector<std::string_view> grams(45, "x"sv);
+        grams[0] = long_gram;
+        ngram_view<45> view = std::span(grams);
+        packed_ngram<45> packed(view);
+        ASSERT(packed == view);
+        ASSERT(packed[0] == long_gram);
+        ASSERT(packed[44] == "x");
+    }
+}
+
+TEST(Ngrams, PackedMapLookup) {
+    ngram_map<2, int> map;
+    map[ngram_view<2>{"foo", "bar"}] = 1;
+    map[ngram_view<2>{"foo", "a gram long enough that it needs to overflow"}] = 2;
+    ASSERT(map.find(ngram_view<2>{"foo", "bar"})->second == 1);
+    ASSERT(map.find(ngram_view<2>{"foo", "a gram long enough that it needs to overflow"})->second == 2);
+    ASSERT(map.find(ngram_view<2>{"foob", "ar"}) == map.end());
+}
+
+TEST(Ngrams, Snowflakes) {
+    std::string_view input = "foo <@331718482485837825> bar 12345 baz 1091618654405283940'";
+    std::vector<std::optional<ngram<2>>> expected{
+        std::nullopt,
+        std::nullopt,
+        {{"bar", "12345"}},
+        {{"12345", "baz"}}
+    };
+    std::vector<std::optional<ngram<2>>> output;
+    tokenize(input, [&](const ngram_window& gram) {
+        output.push_back(gram.subview<2>().transform([&](auto value) { return ngram<2>(value); }));
+    });
+    ASSERT(output == expected);
+}
+
+TEST(Ngrams, MapMemoryAccounting) {
+    auto before = ngram_memory<4>::account().bytes();
+    {
+        ngram_map<4, int> map;
+        for(int i = 0; i < 1000; i++) {
+            auto number = std::to_string(i);
+            map[ngram_view<4>{"foo"sv, "bar"sv, "baz"sv, std::string_view(number)}] = i;
+        }
+        ASSERT(ngram_memory<4>::account().bytes() >= before + 1000 * sizeof(*map.begin()));
+    }
+    ASSERT(ngram_memory<4>::account().bytes() == before);
+}
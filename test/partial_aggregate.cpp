@@ -0,0 +1,77 @@
+#include <filesystem>
+#include <vector>
+
+#include "partial_aggregate.hpp"
+
+#include <libassert/assert-gtest.hpp> // has to come last, not ideal
+
+namespace {
+    struct record {
+        ngram<1> key;
+        std::uint64_t total;
+        std::vector<month_count> months;
+
+        bool operator==(const record&) const = default;
+    };
+
+    // only unigrams, every other width gets an empty section
+    void write_partial(const std::filesystem::path& path, sys_ms from, sys_ms to, const std::vector<record>& records) {
+        partial_aggregate_writer writer(path, false, from, to);
+        for(std::size_t width = 1; width <= ngram_max_width; width++) {
+            writer.begin_section();
+            if(width == 1) {
+                for(const auto& [key, total, months] : records) {
+                    writer.write_record(key, total, months);
+                }
+            }
+        }
+        writer.close();
+    }
+}
+
+TEST(PartialAggregate, RoundTrip) {
+    auto path = std::filesystem::temp_directory_path() / "partial_test.0";
+    std::vector<record> records{{{"a"}, 3, {{0, 1}, {2, 2}}}, {{"b"}, 7, {{1, 7}}}};
+    write_partial(path, sys_ms(1000ms), sys_ms(2000ms), records);
+    partial_aggregate partial(path);
+    ASSERT(!partial.case_folded());
+    ASSERT(partial.from() == sys_ms(1000ms));
+    ASSERT(partial.to() == sys_ms(2000ms));
+    ASSERT(partial.records(0, 1) == 2);
+    ASSERT(partial.records(0, 2) == 0);
+    partial_reader<1> reader(partial, 0);
+    std::vector<record> read;
+    while(reader.next()) {
+        read.push_back({reader.key(), reader.total(), {reader.months().begin(), reader.months().end()}});
+    }
+    ASSERT(read == records);
+    std::filesystem::remove(path);
+}
+
+TEST(PartialAggregate, Merge) {
+    auto directory = std::filesystem::temp_directory_path();
+    std::vector<std::filesystem::path> paths{directory / "partial_test.1", directory / "partial_test.2"};
+    // the ranges split month 1
+    write_partial(paths[0], sys_ms(0ms), sys_ms(1000ms), {{{"a"}, 3, {{0, 1}, {1, 2}}}, {{"c"}, 1, {{0, 1}}}});
+    write_partial(paths[1], sys_ms(1000ms), sys_ms(2000ms), {{{"a"}, 5, {{1, 4}, {2, 1}}}, {{"b"}, 2, {{2, 2}}}});
+    partial_aggregate first(paths[0]);
+    partial_aggregate second(paths[1]);
+    std::vector<const partial_aggregate*> partials{&first, &second};
+    std::vector<record> merged;
+    merge_partial_aggregates<1>(
+        partials,
+        0,
+        [&](const ngram_view<1>& key, std::uint64_t total, std::span<const month_count> months) {
+            merged.push_back({key, total, {months.begin(), months.end()}});
+        }
+    );
+    std::vector<record> expected{
+        {{"a"}, 8, {{0, 1}, {1, 6}, {2, 1}}},
+        {{"b"}, 2, {{2, 2}}},
+        {{"c"}, 1, {{0, 1}}}
+    };
+    ASSERT(merged == expected);
+    for(const auto& path : paths) {
+        std::filesystem::remove(path);
+    }
+}
@@ -0,0 +1,42 @@
+#include <filesystem>
+#include <string>
+
+#include "utils/serialization.hpp"
+
+#include <libassert/assert-gtest.hpp>
+
+using namespace std::literals;
+
+TEST(Serialization, RoundTrip) {
+    auto path = std::filesystem::temp_directory_path() / "ngrams_serialization_test.bin";
+    std::string long_string(3 * 1024 * 1024, 'x');
+    {
+        binary_writer writer(path);
+        writer.write(std::uint32_t(42));
+        writer.write_varint(0);
+        writer.write_varint(300);
+        writer.write_varint(~std::uint64_t(0));
+        writer.write("foo"sv);
+        writer.write(std::string_view(long_string));
+        writer.write(std::array<std::uint64_t, 2>{1, 2});
+        writer.close();
+    }
+    {
+        mapped_file file(path);
+        binary_reader reader(file.contents());
+        ASSERT(reader.read<std::uint32_t>() == 42);
+        ASSERT(reader.read_varint() == 0);
+        ASSERT(reader.read_varint() == 300);
+        ASSERT(reader.read_varint() == ~std::uint64_t(0));
+        ASSERT(reader.read_string() == "foo");
+        ASSERT(reader.read_string() == long_string);
+        ASSERT((reader.read<std::array<std::uint64_t, 2>>() == std::array<std::uint64_t, 2>{1, 2}));
+        ASSERT(reader.done());
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(Serialization, Truncated) {
+    binary_reader reader("\x80\x80"sv);
+    EXPECT_THROW(reader.read_varint(), std::runtime_error);
+}
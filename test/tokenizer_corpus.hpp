@@ -0,0 +1,182 @@
+#ifndef TOKENIZER_CORPUS_HPP
+#define TOKENIZER_CORPUS_HPP
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <xoshiro-cpp/XoshiroCpp.hpp>
+
+#include "tokenization.hpp"
+
+using namespace std::literals;
+
+// Seeded generator for tokenizer inputs, shared by the differential fuzz test and the tokenizer benchmark. Each class
+// leans on a different part of the tokenizer so that throughput can be compared per class and so that fuzzing hits
+// the edge cases hand written tests tend to miss.
+
+enum class corpus_class : std::uint8_t {
+    prose,
+    code,
+    urls,
+    mentions,
+    unicode,
+    delimiters,
+    apostrophes,
+    random_bytes
+};
+
+constexpr std::array corpus_classes = {
+    corpus_class::prose,
+    corpus_class::code,
+    corpus_class::urls,
+    corpus_class::mentions,
+    corpus_class::unicode,
+    corpus_class::delimiters,
+    corpus_class::apostrophes,
+    corpus_class::random_bytes
+};
+
+constexpr std::array corpus_class_names = {
+    "prose"sv,
+    "code"sv,
+    "urls"sv,
+    "mentions"sv,
+    "unicode"sv,
+    "delimiters"sv,
+    "apostrophes"sv,
+    "random_bytes"sv
+};
+
+namespace detail {
+    constexpr std::array corpus_words = {
+        "the"sv, "a"sv, "is"sv, "to"sv, "of"sv, "and"sv, "it"sv, "you"sv, "that"sv, "in"sv, "for"sv, "this"sv,
+        "pointer"sv, "template"sv, "compiler"sv, "undefined"sv, "behavior"sv, "vector"sv, "c++"sv, "c"sv, "i"sv,
+        "don't"sv, "isn't"sv, "it's"sv, "you're"sv, "well-defined"sv, "non-trivial"sv, "lol"sv, "UB"sv, "RAII"sv
+    };
+    constexpr std::array corpus_code_tokens = {
+        "std::vector<int>"sv, "auto&&"sv, "x->y"sv, "i++"sv, "--i"sv, "a+=b"sv, "#include"sv, "<iostream>"sv,
+        "int main()"sv, "{"sv, "}"sv, "return 0;"sv, "nullptr"sv, "constexpr"sv, "[&](auto x)"sv, "0x7fff'ffff"sv,
+        "1'000'000"sv, "operator<=>"sv, "::"sv, "`code`"sv, "\\n"sv, "/* comment */"sv, "// comment"sv
+    };
+    constexpr std::array corpus_unicode_tokens = {
+        "café"sv, "naïve"sv, "Ελληνικά"sv, "привет"sv, "Ճանապարհ"sv, "日本語"sv, "한국어"sv, "👍"sv, "👩‍💻"sv,
+        "🇫🇷"sv, "e\xcc\x81"sv, "ＦＵＬＬ"sv, "ß"sv, "İstanbul"sv, "‘quoted’"sv, "—"sv, "…"sv, "\xc2\xa0"sv
+    };
+    constexpr std::string_view corpus_delimiters = " \t\n\r\v!\"#$%&()*,./:;<=>?@[\\]^`{|}~'-+";
+
+    inline std::size_t pick(XoshiroCpp::Xoroshiro128Plus& rng, std::size_t n) {
+        return rng() % n;
+    }
+
+    template<typename T, std::size_t N>
+    const T& pick(XoshiroCpp::Xoroshiro128Plus& rng, const std::array<T, N>& options) {
+        return options[pick(rng, N)];
+    }
+
+    inline void append_digits(std::string& out, XoshiroCpp::Xoroshiro128Plus& rng, std::size_t length) {
+        for(std::size_t i = 0; i < length; i++) {
+            out += char('0' + pick(rng, 10));
+        }
+    }
+
+    inline void append_token(std::string& out, corpus_class cls, XoshiroCpp::Xoroshiro128Plus& rng) {
+        switch(cls) {
+            case corpus_class::prose:
+                out += pick(rng, corpus_words);
+                out += pick(rng, std::array{" "sv, " "sv, " "sv, ", "sv, ". "sv, "? "sv, "\n"sv, "! "sv});
+                break;
+            case corpus_class::code:
+                if(pick(rng, 20) == 0) {
+                    out += pick(rng, std::array{"```cpp\n"sv, "```\n"sv, "\n```"sv});
+                }
+                out += pick(rng, corpus_code_tokens);
+                out += pick(rng, std::array{" "sv, "\n    "sv, ";"sv, "("sv, ")"sv});
+                break;
+            case corpus_class::urls:
+                out += pick(rng, std::array{"https://"sv, "http://"sv, "<https://"sv, ""sv});
+                out += pick(rng, std::array{"en.cppreference.com"sv, "godbolt.org"sv, "discord.com"sv, "x.y"sv});
+                for(auto segments = pick(rng, 4); segments > 0; segments--) {
+                    out += '/';
+                    out += pick(rng, corpus_words);
+                }
+                out += pick(rng, std::array{""sv, "?q=1&x=y"sv, "#section-2"sv, ">"sv, "/"sv});
+                out += ' ';
+                break;
+            case corpus_class::mentions:
+                out += pick(rng, std::array{"<@"sv, "<@!"sv, "<#"sv, "<@&"sv, "<:emoji:"sv, ""sv, " "sv});
+                // snowflakes are 17-19 digits, lengths just outside the range are ordinary numbers
+                append_digits(out, rng, 15 + pick(rng, 7));
+                out += pick(rng, std::array{">"sv, "> "sv, "' "sv, "- "sv, " "sv, "x "sv});
+                out += pick(rng, corpus_words);
+                out += ' ';
+                break;
+            case corpus_class::unicode:
+                out += pick(rng, corpus_unicode_tokens);
+                out += pick(rng, std::array{" "sv, ""sv, "-"sv, "'"sv, ". "sv});
+                break;
+            case corpus_class::delimiters:
+                for(auto run = pick(rng, 40); run > 0; run--) {
+                    out += corpus_delimiters[pick(rng, corpus_delimiters.size())];
+                }
+                out += pick(rng, corpus_words);
+                break;
+            case corpus_class::apostrophes:
+                out += pick(
+                    rng,
+                    std::array{
+                        "'"sv, "''"sv, "-"sv, "--"sv, "'-'"sv, "+"sv, "++"sv, "a'"sv, "'a"sv, "a-"sv, "-a"sv, "a-b-"sv,
+                        "'tis"sv, "rock'n'roll"sv, "x--"sv, "--x"sv, "1'000"sv
+                    }
+                );
+                out += pick(rng, std::array{" "sv, ""sv, "\t"sv, ","sv});
+                break;
+            case corpus_class::random_bytes:
+                out += char(rng() & 0xff);
+                break;
+        }
+    }
+}
+
+// Generates one message of roughly target_size bytes
+inline std::string generate_message(corpus_class cls, XoshiroCpp::Xoroshiro128Plus& rng, std::size_t target_size) {
+    std::string message;
+    while(message.size() < target_size) {
+        detail::append_token(message, cls, rng);
+    }
+    return message;
+}
+
+// A deliberately naive tokenizer to check tokenize against. Produces the grams in order, with std::nullopt where
+// the ngram window is broken by a snowflake.
+inline std::vector<std::optional<std::string_view>> reference_tokenize(std::string_view str) {
+    std::vector<std::optional<std::string_view>> grams;
+    std::size_t cursor = 0;
+    while(true) {
+        auto start = str.find_first_not_of(before_gram_delimiters, cursor);
+        if(start == std::string_view::npos) {
+            break;
+        }
+        auto end = std::min(str.find_first_of(end_of_gram_delimiters, start), str.size());
+        cursor = end;
+        auto gram = str.substr(start, end - start);
+        while(!gram.empty() && not_at_end.contains(gram.back())) {
+            gram.remove_suffix(1);
+        }
+        if(gram.empty()) {
+            continue;
+        }
+        bool all_digits = gram.find_first_not_of("0123456789") == std::string_view::npos;
+        if(all_digits && gram.size() >= snowflake_min_length && gram.size() <= snowflake_max_length) {
+            grams.push_back(std::nullopt);
+        } else {
+            grams.push_back(gram);
+        }
+    }
+    return grams;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+#include <xoshiro-cpp/XoshiroCpp.hpp>
+
+#include "ngram.hpp"
+#include "tokenization.hpp"
+#include "tokenizer_corpus.hpp"
+
+#include <libassert/assert-gtest.hpp> // has to come last, not ideal
+
+using window_contents = std::vector<std::vector<std::string_view>>;
+
+// the windows tokenize should produce, built from the reference tokenizer's grams
+static window_contents reference_windows(std::string_view message) {
+    window_contents windows;
+    std::vector<std::string_view> window;
+    for(const auto& gram : reference_tokenize(message)) {
+        if(!gram) {
+            window.clear();
+            continue;
+        }
+        if(window.size() == ngram_max_width) {
+            window.erase(window.begin());
+        }
+        window.push_back(*gram);
+        windows.push_back(window);
+    }
+    return windows;
+}
+
+static window_contents tokenized_windows(std::string_view message) {
+    window_contents windows;
+    tokenize(message, [&](const ngram_window& window) {
+        windows.emplace_back(window.begin(), window.end());
+    });
+    return windows;
+}
+
+TEST(TokenizerFuzz, MatchesReference) {
+    XoshiroCpp::Xoroshiro128Plus rng(0x746f6b656e);
+    for(auto cls : corpus_classes) {
+        for(int i = 0; i < 2000; i++) {
+            auto message = generate_message(cls, rng, rng() % 400);
+            ASSERT(
+                tokenized_windows(message) == reference_windows(message),
+                corpus_class_names[std::size_t(cls)],
+                message
+            );
+        }
+    }
+}
+
+TEST(TokenizerFuzz, EdgeCases) {
+    for(
+        std::string_view message : {
+            ""sv, "'"sv, "-"sv, "'-'-"sv, "a'"sv, "'a'"sv, "c++"sv, "++c"sv, "a-'"sv, "x\xff"sv,
+            "12345678901234567"sv, "1234567890123456"sv, "12345678901234567890"sv, "12345678901234567-'"sv,
+            "a 12345678901234567 b"sv, "a b c d e f g"sv
+        }
+    ) {
+        ASSERT(tokenized_windows(message) == reference_windows(message), message);
+    }
+}
@@ -4,13 +4,14 @@ import * as d3 from "d3";
 import * as Plot from "@observablehq/plot";
 import moment from "moment";
 
-import { encoded_query_response, query_result } from "../shared/schema";
-import { debounce, http_get, round_down_exponential } from "./utils";
-import { first_bucket, last_bucket, maybe_slash } from "../shared/common";
+import { complete_response, encoded_query_response, encoded_query_result, query_result } from "../shared/schema";
+import { debounce, http_get, LruCache, round_down_exponential } from "./utils";
+import { first_bucket, last_bucket, max_query_parts, maybe_slash, query_parts } from "../shared/common";
 import { occlusionY } from "./occlusion";
 
 class App {
     query_input: HTMLInputElement;
+    completions: HTMLDataListElement;
     case_insensitive_button: HTMLElement;
     combine_button: HTMLElement;
     smooth_button: HTMLElement;
@@ -28,10 +29,29 @@ class App {
         time: 0,
     };
 
+    // results of individual query parts, keyed by the part and the options it was queried with
+    part_cache = new LruCache<string, encoded_query_result>(256);
+    // the database the cached parts came from, undefined until the first response
+    database_version: string | null | undefined = undefined;
+    pending: AbortController | null = null;
+
     constructor() {
         this.query_input = document.getElementById("query")! as HTMLInputElement;
         this.query = this.query_input.value;
         this.query_input.addEventListener("keyup", debounce(this.query_keystroke.bind(this), 500), false);
+        // completions are cheap, they're fetched much sooner than the query itself
+        this.query_input.addEventListener("keyup", debounce(this.complete.bind(this), 100), false);
+        // picking a completion doesn't necessarily come with a keystroke
+        this.query_input.addEventListener(
+            "change",
+            () => {
+                if (this.query_input.value !== this.query) {
+                    this.query_keystroke();
+                }
+            },
+            false,
+        );
+        this.completions = document.getElementById("completions")! as HTMLDataListElement;
         this.case_insensitive_button = document.getElementById("case-insensitive")!;
         this.case_insensitive_button.addEventListener("click", this.case_insensitive_button_press.bind(this), false);
         this.combine_button = document.getElementById("combine-series")!;
@@ -76,6 +96,32 @@ class App {
         this.do_query();
     }
 
+    complete() {
+        const value = this.query_input.value;
+        const endpoint = `${maybe_slash(import.meta.env.BASE_URL)}complete`;
+        http_get(`${endpoint}?q=${encodeURIComponent(value)}&ci=${this.case_insensitive}`, (res: string | Error) => {
+            // stale or failed completions are just dropped
+            if (res instanceof Error || value !== this.query_input.value) {
+                return;
+            }
+            try {
+                const { completions } = JSON.parse(res) as complete_response;
+                // options are whole input values, the completion replaces the last part of the query
+                const head = value.slice(0, value.lastIndexOf(",") + 1);
+                const separator = head === "" ? "" : " ";
+                this.completions.replaceChildren(
+                    ...completions.map(completion => {
+                        const option = document.createElement("option");
+                        option.value = head + separator + completion;
+                        return option;
+                    }),
+                );
+            } catch (e) {
+                console.log(e);
+            }
+        });
+    }
+
     static months_after_first_bucket(months: number) {
         return Date.UTC(first_bucket[0], first_bucket[1] + months);
     }
@@ -84,6 +130,14 @@ class App {
         // we get an array of results for each part of the query
         // we want to consolidate down to a single dict, keeping the order (we use that for the color domain)
         this.timing.innerHTML = `Query time: ${response.time} ms`;
+        if (response.timing) {
+            const { planning, execution, serialization } = response.timing;
+            this.timing.title = [
+                `Planning: ${planning.toFixed(1)} ms`,
+                `Execution: ${execution.toFixed(1)} ms`,
+                `Serialization: ${serialization.toFixed(1)} ms`,
+            ].join("\n");
+        }
         const consolidated_result: query_result = new Map(response.series.flat(1));
         const last_bucket_ts = new Date(...last_bucket).getTime();
         // fill in gaps
@@ -299,12 +353,42 @@ class App {
         this.error.setAttribute("class", "invisible");
     }
 
+    static part_key(part: string, case_insensitive: boolean, combine: boolean) {
+        return JSON.stringify([part.split(/\s+/).join(" "), case_insensitive, combine]);
+    }
+
     do_query() {
+        // a newer query supersedes whatever is still in flight
+        this.pending?.abort();
+        this.pending = null;
+        const parts = query_parts(this.query);
+        if (parts.length > max_query_parts) {
+            this.set_error(`Query has too many parts (max ${max_query_parts})`);
+            return;
+        }
+        const keys = parts.map(part => App.part_key(part, this.case_insensitive, this.combine));
+        // only parts that haven't been fetched yet are queried, each once no matter how often it appears
+        const missing = new Map<string, string>();
+        for (const [i, key] of keys.entries()) {
+            if (this.part_cache.get(key) === undefined) {
+                missing.set(key, parts[i]);
+            }
+        }
+        if (missing.size === 0) {
+            this.clear_error();
+            this.last_query_res = { series: keys.map(key => this.part_cache.get(key)!), time: 0 };
+            this.render_chart();
+            return;
+        }
         this.timing.innerHTML = `Querying...`;
+        const controller = new AbortController();
+        this.pending = controller;
         const endpoint = `${maybe_slash(import.meta.env.BASE_URL)}query`;
+        const query = [...missing.values()].join(",");
         http_get(
-            `${endpoint}?q=${encodeURIComponent(this.query)}&ci=${this.case_insensitive}&combine=${this.combine}`,
+            `${endpoint}?q=${encodeURIComponent(query)}&ci=${this.case_insensitive}&combine=${this.combine}`,
             (res: string | Error) => {
+                this.pending = null;
                 if (res instanceof Error) {
                     this.set_error(res.message);
                     return;
@@ -313,16 +397,36 @@ class App {
                     const raw_data = JSON.parse(res) as encoded_query_response;
                     if (raw_data.error) {
                         this.set_error(raw_data.error);
-                    } else {
-                        this.clear_error();
+                        this.last_query_res = raw_data;
+                        this.render_chart();
+                        return;
+                    }
+                    this.clear_error();
+                    // cached parts are stale once a new database is published
+                    if (raw_data.version !== this.database_version) {
+                        const had_cached_parts = this.database_version !== undefined;
+                        this.part_cache.clear();
+                        this.database_version = raw_data.version;
+                        if (had_cached_parts && missing.size < new Set(keys).size) {
+                            this.do_query();
+                            return;
+                        }
+                    }
+                    const fetched = new Map([...missing.keys()].map((key, i) => [key, raw_data.series[i]]));
+                    for (const [key, series] of fetched) {
+                        this.part_cache.set(key, series);
                     }
-                    this.last_query_res = raw_data;
+                    this.last_query_res = {
+                        ...raw_data,
+                        series: keys.map(key => fetched.get(key) ?? this.part_cache.get(key)!),
+                    };
                     this.render_chart();
                 } catch (e) {
                     this.set_error(`Internal error ${e}`);
                     console.log(e);
                 }
             },
+            controller.signal,
         );
     }
 }
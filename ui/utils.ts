@@ -1,8 +1,10 @@
-export function http_get(url: string, callback: (x: string | Error) => any) {
+// the callback isn't invoked for aborted requests
+export function http_get(url: string, callback: (x: string | Error) => any, signal?: AbortSignal) {
     const request = new XMLHttpRequest();
+    signal?.addEventListener("abort", () => request.abort());
     request.onreadystatechange = function () {
-        if (request.readyState == 4) {
-            if (request.status == 200 || request.status == 500) {
+        if (request.readyState == 4 && !signal?.aborted) {
+            if ([200, 500, 503, 504].includes(request.status)) {
                 callback(request.responseText);
             } else {
                 callback(new Error(`HTTP Error ${request.statusText}`));
@@ -13,6 +15,34 @@ export function http_get(url: string, callback: (x: string | Error) => any) {
     request.send(null);
 }
 
+// Map based LRU, maps iterate in insertion order so the first key is the least recently used
+export class LruCache<K, V> {
+    private entries = new Map<K, V>();
+
+    constructor(private capacity: number) {}
+
+    get(key: K) {
+        const value = this.entries.get(key);
+        if (value !== undefined) {
+            this.entries.delete(key);
+            this.entries.set(key, value);
+        }
+        return value;
+    }
+
+    set(key: K, value: V) {
+        this.entries.delete(key);
+        this.entries.set(key, value);
+        if (this.entries.size > this.capacity) {
+            this.entries.delete(this.entries.keys().next().value!);
+        }
+    }
+
+    clear() {
+        this.entries.clear();
+    }
+}
+
 // https://stackoverflow.com/questions/75988682/debounce-in-javascript
 export function debounce(callback: (...args: any[]) => void, wait: number) {
     // eslint-disable-next-line @typescript-eslint/naming-convention